@@ -0,0 +1,176 @@
+# Profile-guided optimization (CMAKE_BUILD_TYPE=PGO).
+#
+# The PGO build type works in two phases:
+#
+# 1. A nested build of this project (BEECTL_PGO_PHASE=GENERATE) produces an
+#    instrumented beectl under ${CMAKE_BINARY_DIR}/pgo-instrumented.
+# 2. CMake/pgo-training.py runs a deterministic workload against the
+#    instrumented binary (framed requests of mixed sizes, a fake editor doing
+#    scripted saves, response encoding). The resulting profile is then used to
+#    compile the beectl target of this build with LTO.
+#
+# Supported with GCC (>= 11) and Clang on Linux.
+#
+# Expects the `beectl` target and BEECTL_SRCS to be defined.
+
+set(BEECTL_PGO_PHASE "" CACHE STRING
+  "Internal: PGO phase of the nested instrumented build (GENERATE)")
+set(BEECTL_PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profile" CACHE PATH
+  "Directory for the PGO profile data")
+mark_as_advanced(BEECTL_PGO_PHASE BEECTL_PGO_PROFILE_DIR)
+
+if(NOT BEECTL_PGO_PHASE STREQUAL "GENERATE" AND NOT CMAKE_BUILD_TYPE STREQUAL "PGO")
+  return()
+endif()
+
+if(NOT CMAKE_SYSTEM_NAME STREQUAL "Linux")
+  message(FATAL_ERROR "PGO build is only supported on Linux")
+endif()
+# The toolchain files set CMAKE_SYSTEM_NAME, which makes CMake consider every
+# build a cross build. The instrumented binary runs fine as long as the target
+# is the host itself.
+if(CMAKE_CROSSCOMPILING)
+  set(pgo_host_processor "${CMAKE_HOST_SYSTEM_PROCESSOR}")
+  set(pgo_target_processor "${CMAKE_SYSTEM_PROCESSOR}")
+  foreach(pgo_var pgo_host_processor pgo_target_processor)
+    string(TOLOWER "${${pgo_var}}" ${pgo_var})
+    if(${pgo_var} STREQUAL "amd64")
+      set(${pgo_var} "x86_64")
+    elseif(${pgo_var} STREQUAL "arm64")
+      set(${pgo_var} "aarch64")
+    endif()
+  endforeach()
+  if(NOT CMAKE_HOST_SYSTEM_NAME STREQUAL CMAKE_SYSTEM_NAME
+     OR NOT pgo_host_processor STREQUAL pgo_target_processor)
+    message(FATAL_ERROR "PGO build requires running the instrumented binary; "
+                        "cross-compilation is not supported")
+  endif()
+endif()
+
+include(CheckCCompilerFlag)
+
+if(CMAKE_C_COMPILER_ID STREQUAL "GNU")
+  # By default, GCC names the .gcda files after the absolute paths of the
+  # object files. Strip the build directory so that the profile generated by
+  # the nested build matches the objects of this build.
+  check_c_compiler_flag("-fprofile-prefix-path=${CMAKE_BINARY_DIR}"
+    HAVE_FPROFILE_PREFIX_PATH)
+  if(NOT HAVE_FPROFILE_PREFIX_PATH)
+    message(FATAL_ERROR "PGO build requires GCC 11 or newer")
+  endif()
+  set(pgo_prefix_flag "-fprofile-prefix-path=${CMAKE_BINARY_DIR}")
+elseif(CMAKE_C_COMPILER_ID MATCHES "Clang")
+  get_filename_component(pgo_compiler_dir "${CMAKE_C_COMPILER}" DIRECTORY)
+  string(REGEX MATCH "^[0-9]+" pgo_clang_major "${CMAKE_C_COMPILER_VERSION}")
+  find_program(LLVM_PROFDATA
+    NAMES llvm-profdata
+          "llvm-profdata-${pgo_clang_major}"
+    HINTS "${pgo_compiler_dir}")
+  if(NOT LLVM_PROFDATA)
+    message(FATAL_ERROR "PGO build with Clang requires llvm-profdata")
+  endif()
+  set(pgo_prefix_flag "")
+else()
+  message(FATAL_ERROR "PGO build is not supported for ${CMAKE_C_COMPILER_ID}")
+endif()
+
+if(BEECTL_PGO_PHASE STREQUAL "GENERATE")
+  message(STATUS "PGO: building instrumented beectl (profile: ${BEECTL_PGO_PROFILE_DIR})")
+
+  target_compile_options(beectl PRIVATE
+    "-fprofile-generate=${BEECTL_PGO_PROFILE_DIR}"
+    ${pgo_prefix_flag})
+  if(CMAKE_C_COMPILER_ID STREQUAL "GNU")
+    # libuv may run callbacks on its threadpool
+    target_compile_options(beectl PRIVATE -fprofile-update=prefer-atomic)
+  endif()
+  set_property(TARGET beectl APPEND_STRING PROPERTY
+    LINK_FLAGS " -fprofile-generate=${BEECTL_PGO_PROFILE_DIR}")
+  return()
+endif()
+
+# CMAKE_BUILD_TYPE=PGO: optimize like Release
+foreach(lang_flags CMAKE_C_FLAGS CMAKE_EXE_LINKER_FLAGS)
+  if(NOT DEFINED ${lang_flags}_PGO)
+    set(${lang_flags}_PGO "${${lang_flags}_RELEASE}" CACHE STRING
+      "Flags used by the PGO build type")
+  endif()
+endforeach()
+
+find_package(Python3 REQUIRED COMPONENTS Interpreter)
+
+include(CheckIPOSupported)
+check_ipo_supported(RESULT pgo_ipo_supported OUTPUT pgo_ipo_output LANGUAGES C)
+if(NOT pgo_ipo_supported)
+  message(FATAL_ERROR "PGO build requires LTO support: ${pgo_ipo_output}")
+endif()
+
+set(pgo_instrumented_dir "${CMAKE_BINARY_DIR}/pgo-instrumented")
+set(pgo_stamp "${BEECTL_PGO_PROFILE_DIR}.stamp")
+
+set(pgo_cmake_args
+  -DCMAKE_BUILD_TYPE=Release
+  -DBEECTL_PGO_PHASE=GENERATE
+  -DBEECTL_PGO_PROFILE_DIR=${BEECTL_PGO_PROFILE_DIR}
+  -DUSE_SYSTEM_DEPS=${USE_SYSTEM_DEPS}
+  -DCMAKE_C_COMPILER=${CMAKE_C_COMPILER}
+  -DCMAKE_C_FLAGS=${CMAKE_C_FLAGS}
+  -DCMAKE_EXE_LINKER_FLAGS=${CMAKE_EXE_LINKER_FLAGS}
+)
+if(CMAKE_TOOLCHAIN_FILE)
+  list(APPEND pgo_cmake_args -DCMAKE_TOOLCHAIN_FILE:FILEPATH=${CMAKE_TOOLCHAIN_FILE})
+endif()
+
+ExternalProject_Add(beectl_pgo_instrumented
+  SOURCE_DIR "${CMAKE_SOURCE_DIR}"
+  BINARY_DIR "${pgo_instrumented_dir}"
+  CMAKE_ARGS ${pgo_cmake_args}
+  BUILD_COMMAND ${CMAKE_COMMAND} --build <BINARY_DIR> --target beectl
+  BUILD_ALWAYS 1
+  INSTALL_COMMAND ""
+  TEST_COMMAND ""
+)
+
+set(pgo_training_args
+  --beectl "${pgo_instrumented_dir}/beectl"
+  --profile-dir "${BEECTL_PGO_PROFILE_DIR}")
+if(LLVM_PROFDATA)
+  list(APPEND pgo_training_args
+    --llvm-profdata "${LLVM_PROFDATA}"
+    --output "${BEECTL_PGO_PROFILE_DIR}/beectl.profdata")
+endif()
+
+add_custom_command(OUTPUT "${pgo_stamp}"
+  COMMAND ${CMAKE_COMMAND} -E remove_directory "${BEECTL_PGO_PROFILE_DIR}"
+  COMMAND ${CMAKE_COMMAND} -E make_directory "${BEECTL_PGO_PROFILE_DIR}"
+  COMMAND "${Python3_EXECUTABLE}"
+          "${CMAKE_SOURCE_DIR}/CMake/pgo-training.py" ${pgo_training_args}
+  COMMAND ${CMAKE_COMMAND} -E touch "${pgo_stamp}"
+  DEPENDS beectl_pgo_instrumented
+          "${CMAKE_SOURCE_DIR}/CMake/pgo-training.py"
+          ${BEECTL_SRCS}
+  COMMENT "Running PGO training workload"
+  VERBATIM
+)
+add_custom_target(beectl_pgo_profile DEPENDS "${pgo_stamp}")
+add_dependencies(beectl beectl_pgo_profile)
+
+# Recompile the sources whenever the profile is regenerated
+set_source_files_properties(${BEECTL_SRCS} PROPERTIES OBJECT_DEPENDS "${pgo_stamp}")
+
+if(LLVM_PROFDATA)
+  target_compile_options(beectl PRIVATE
+    "-fprofile-use=${BEECTL_PGO_PROFILE_DIR}/beectl.profdata"
+    -Wno-profile-instr-unprofiled)
+else()
+  target_compile_options(beectl PRIVATE
+    "-fprofile-use=${BEECTL_PGO_PROFILE_DIR}"
+    ${pgo_prefix_flag}
+    # Optimize the code paths the workload doesn't reach as usual rather
+    # than treating them as never executed.
+    -fprofile-partial-training
+    -Wno-missing-profile)
+endif()
+set_property(TARGET beectl PROPERTY INTERPROCEDURAL_OPTIMIZATION TRUE)
+
+message(STATUS "PGO: profile-guided build with LTO enabled")
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+# PGO training workload for beectl (see CMake/PGO.cmake).
+#
+# Drives an instrumented beectl through a fixed set of sessions: framed
+# requests of mixed sizes and contents, a fake editor (this script invoked
+# with --fake-editor) doing scripted saves, and encoding of the responses.
+# The workload is deterministic: texts are generated from a fixed seed.
+#
+# Usage:
+#   pgo-training.py --beectl PATH --profile-dir DIR
+#                   [--llvm-profdata PATH --output FILE]
+
+import argparse
+import glob
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import time
+
+SEED = 20190111
+
+# Pause between the scripted saves of the fake editor. Must exceed the
+# debounce delay of the host so that every save yields a response.
+SAVE_INTERVAL = 0.25
+
+# Delay before the first save; gives the host time to start watching.
+FIRST_SAVE_DELAY = 0.4
+
+SAMPLE_UNICODE = "ʳkʊs kuːn — ∮ E⋅da = Q, ∀x∈ℝ: ⌈x⌉ = −⌊−x⌋ ði ıntəˈnæʃənəl 🐝"
+SAMPLE_ESCAPES = '"quoted" back\\slash \t tab \r\n \x01\x1f\x08\x0c /'
+
+
+def make_text(rng, size, kind):
+    """Builds a text of approximately `size` characters"""
+    if kind == "ascii":
+        alphabet = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ 0123456789.,\n"
+        return "".join(rng.choice(alphabet) for _ in range(size))
+    if kind == "unicode":
+        pieces = [SAMPLE_UNICODE, "plain ascii words ", "\n"]
+    elif kind == "escapes":
+        pieces = [SAMPLE_ESCAPES, "plain ascii words ", "\n"]
+    else:  # mixed
+        pieces = [SAMPLE_UNICODE, SAMPLE_ESCAPES, "plain ascii words " * 4, "\n"]
+    out = []
+    n = 0
+    while n < size:
+        piece = rng.choice(pieces)
+        out.append(piece)
+        n += len(piece)
+    return "".join(out)
+
+
+def fake_editor(path, saves):
+    """Scripted saves of a fake editor.
+
+    Covers both in-place writes and write-to-temp-then-rename (the way vim
+    and many other editors save files)."""
+    time.sleep(FIRST_SAVE_DELAY)
+    for i in range(saves):
+        with open(path, "rb") as f:
+            data = f.read()
+        data += ("\nsave %d: %s" % (i, SAMPLE_UNICODE)).encode("utf-8")
+        if i % 2:
+            tmp = path + ".swp"
+            with open(tmp, "wb") as f:
+                f.write(data)
+            os.replace(tmp, path)
+        else:
+            with open(path, "wb") as f:
+                f.write(data)
+        time.sleep(SAVE_INTERVAL)
+
+
+def frame(obj):
+    body = json.dumps(obj).encode("utf-8")
+    return struct.pack("=I", len(body)) + body
+
+
+def read_frames(data):
+    frames = []
+    i = 0
+    while i + 4 <= len(data):
+        (n,) = struct.unpack("=I", data[i : i + 4])
+        frames.append(data[i + 4 : i + 4 + n])
+        i += 4 + n
+    return frames
+
+
+def run_session(beectl, env, request, name):
+    proc = subprocess.run(
+        [beectl],
+        input=request,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.DEVNULL,
+        env=env,
+        timeout=120,
+    )
+    frames = read_frames(proc.stdout)
+    print("pgo-training: %-24s exit=%d responses=%d" % (name, proc.returncode, len(frames)))
+    for f in frames:
+        # Make sure the host produced valid JSON
+        json.loads(f.decode("utf-8"))
+    return proc.returncode
+
+
+def train(args):
+    rng = random.Random(SEED)
+    env = dict(os.environ)
+    # Clang: one raw profile per process; merged by llvm-profdata below
+    env["LLVM_PROFILE_FILE"] = os.path.join(args.profile_dir, "beectl-%p.profraw")
+
+    editor = [sys.executable, os.path.abspath(__file__), "--fake-editor"]
+    sessions = [
+        ("empty", 0, "ascii", 1),
+        ("small-ascii", 64, "ascii", 3),
+        ("small-unicode", 512, "unicode", 3),
+        ("escapes", 4 * 1024, "escapes", 3),
+        ("medium-mixed", 256 * 1024, "mixed", 3),
+        ("large-ascii", 2 * 1024 * 1024, "ascii", 2),
+        ("large-mixed", 2 * 1024 * 1024, "mixed", 2),
+    ]
+
+    failures = 0
+    for name, size, kind, saves in sessions:
+        request = {
+            "text": make_text(rng, size, kind),
+            "editor": editor[0],
+            "args": editor[1:] + ["--saves", str(saves), "--"],
+            "ext": "txt",
+        }
+        if run_session(args.beectl, env, frame(request), name) != 0:
+            failures += 1
+
+    # Malformed requests exercise the error paths
+    run_session(args.beectl, env, struct.pack("=I", 5) + b"{bad}", "malformed-json")
+    run_session(args.beectl, env, b"\x01\x00", "truncated-frame")
+
+    if failures:
+        sys.exit("pgo-training: %d session(s) failed" % failures)
+
+    if args.llvm_profdata:
+        raw = glob.glob(os.path.join(args.profile_dir, "*.profraw"))
+        if not raw:
+            sys.exit("pgo-training: no raw profiles found in %s" % args.profile_dir)
+        subprocess.check_call([args.llvm_profdata, "merge", "-output=" + args.output] + raw)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl PGO training workload")
+    parser.add_argument("--beectl")
+    parser.add_argument("--profile-dir")
+    parser.add_argument("--llvm-profdata")
+    parser.add_argument("--output")
+    parser.add_argument("--fake-editor", action="store_true")
+    parser.add_argument("--saves", type=int, default=1)
+    parser.add_argument("file", nargs="?")
+    args = parser.parse_args()
+
+    if args.fake_editor:
+        fake_editor(args.file, args.saves)
+        return
+
+    if not args.beectl or not args.profile_dir:
+        parser.error("--beectl and --profile-dir are required")
+    train(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+# Worst-case requests for the admission limits of beectl (see
+# src/admission.h). Every case must be answered with the expected error
+# response within the time and memory bounds.
+#
+# The requests are filters with a missing command, so that no editor is
+# started even if a request is admitted. --unlimited disables the limits to
+# show the cost they bound.
+#
+# Usage:
+#   admission-bench.py --beectl PATH [--max-ms N] [--max-rss-kb N]
+#                      [--unlimited]
+
+import argparse
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+LIMIT_ENVS = ("BEECTL_MAX_FRAME", "BEECTL_MAX_DEPTH", "BEECTL_MAX_VALUES",
+              "BEECTL_MAX_ARGS", "BEECTL_MAX_ARG_LEN")
+
+
+def frame(body):
+    return struct.pack("=I", len(body)) + body
+
+
+def request(**members):
+    members.update(text="", editor="/nonexistent/command", filter=True)
+    return frame(json.dumps(members).encode("utf-8"))
+
+
+def cases():
+    """Yields (name, function making the input, expected error code or
+    None)"""
+    # The length claims 4 GB, but the body never comes
+    yield ("bogus length", lambda: struct.pack("=I", 0xFFFFFFFF),
+           "frame_too_large")
+    yield ("deep nesting",
+           lambda: frame(b'{"filter":true,"x":' + b"[" * 1000000
+                         + b"]" * 1000000 + b"}"),
+           "too_deep")
+    # Brackets in strings don't count. An admitted request fails to run the
+    # command.
+    yield ("brackets in a string", lambda: request(x="[" * 1000000),
+           "filter_failed")
+    # A node per value in any member
+    yield ("large array", lambda: request(zzz=[0] * 8000000),
+           "too_many_values")
+    # Under the limit of the values
+    yield ("many args", lambda: request(args=["-n"] * 50000),
+           "too_many_args")
+    # Every field adds a file and an editor argument
+    yield ("many fields",
+           lambda: request(fields=[{"id": "f%d" % i, "text": ""}
+                                   for i in range(10000)]),
+           "too_many_args")
+    yield ("long arg", lambda: request(args=["x" * (16 * 1024 * 1024)]),
+           "arg_too_long")
+
+
+def write_input(path, make):
+    """Writes the input in a child process. On Linux, the peak RSS of a child
+    includes the peak of this process at the time of the fork, so the
+    inputs are never built here."""
+    pid = os.fork()
+    if pid == 0:
+        with open(path, "wb") as f:
+            f.write(make())
+        os._exit(0)
+    os.waitpid(pid, 0)
+
+
+def read_frames(data):
+    frames = []
+    while len(data) >= 4:
+        (n,) = struct.unpack("=I", data[:4])
+        frames.append(json.loads(data[4:4 + n].decode("utf-8")))
+        data = data[4 + n:]
+    return frames
+
+
+def run(beectl, path, env):
+    """Returns (frames, milliseconds, peak RSS in kB) of one request"""
+    with open(path, "rb") as stdin:
+        start = time.monotonic()
+        proc = subprocess.Popen([beectl], stdin=stdin,
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.DEVNULL, env=env)
+        out = proc.stdout.read()
+        _, _, usage = os.wait4(proc.pid, 0)
+        proc.returncode = 0
+        elapsed_ms = (time.monotonic() - start) * 1000
+    rss_kb = usage.ru_maxrss // (1024 if sys.platform == "darwin" else 1)
+    return read_frames(out), elapsed_ms, rss_kb
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl admission benchmark")
+    parser.add_argument("--beectl", required=True)
+    parser.add_argument("--max-ms", type=float, default=1000,
+                        help="allowed time per request")
+    parser.add_argument("--max-rss-kb", type=int, default=64 * 1024,
+                        help="allowed peak RSS per request")
+    parser.add_argument("--unlimited", action="store_true",
+                        help="disable the limits; only report the costs")
+    args = parser.parse_args()
+
+    env = dict(os.environ)
+    for name in LIMIT_ENVS:
+        if args.unlimited:
+            env[name] = "0"
+        else:
+            env.pop(name, None)
+
+    failures = []
+    fd, path = tempfile.mkstemp(prefix="beectl-admission-")
+    os.close(fd)
+    for name, make, code in cases():
+        if args.unlimited and name == "bogus length":
+            # Would wait for the body forever
+            continue
+        write_input(path, make)
+        frames, elapsed_ms, rss_kb = run(args.beectl, path, env)
+        got = frames[0].get("error", {}).get("code") if frames else None
+        ok = (args.unlimited
+              or (got == code and elapsed_ms <= args.max_ms
+                  and rss_kb <= args.max_rss_kb))
+        print("admission: %-22s %9.1f ms %9d kB  %-16s %s"
+              % (name, elapsed_ms, rss_kb, got or "-", "ok" if ok else "FAILED"))
+        if not ok:
+            failures.append(name)
+
+    os.remove(path)
+
+    if failures:
+        sys.exit("admission: FAILED: %s" % ", ".join(failures))
+    print("admission: passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Scaling of the parallel response escaping of beectl (see
+# json_make_string_object() in src/json.c).
+#
+# Responses are escaped by a single thread, unless the BEECTL_JSON_THREADS
+# environment variable sets up to JSON_MAX_THREADS threads, each with at least
+# JSON_MIN_CHUNK_SIZE bytes (src/json.h). This script sweeps the input size
+# and the number of threads and prints the median time until the response of
+# a `cat` filter request arrives. The other costs of a request grow with its
+# size, but don't depend on the number of threads. Run it on a multi-core
+# machine before changing the default.
+#
+# Usage:
+#   escape-bench.py --beectl PATH [--runs N] [--sizes MB,...]
+#                   [--threads N,...]
+
+import argparse
+import json
+import os
+import random
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+SEED = 20190111
+
+# Characters to escape and multi-byte characters among plain words, so that
+# every kernel of the escaping runs
+PIECES = ['"quoted" back\\slash \t tab \x01', "ʳkʊs kuːn — ∮ E⋅da 🐝",
+          "plain ascii words " * 4, "\n"]
+
+
+def make_request(rng, size):
+    out = []
+    n = 0
+    while n < size:
+        piece = rng.choice(PIECES)
+        out.append(piece)
+        n += len(piece.encode("utf-8"))
+    request = {"text": "".join(out), "editor": "/bin/cat", "filter": True}
+    body = json.dumps(request, ensure_ascii=False).encode("utf-8")
+    return struct.pack("=I", len(body)) + body
+
+
+def run(beectl, request, env):
+    """Returns the milliseconds from the launch until the response"""
+    start = time.perf_counter_ns()
+    proc = subprocess.run([beectl], input=request, stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL, env=env)
+    elapsed = time.perf_counter_ns() - start
+    if proc.returncode != 0 or len(proc.stdout) < 4:
+        sys.exit("escape: %s failed (exit %d)" % (beectl, proc.returncode))
+    return elapsed / 1e6
+
+
+def int_list(value):
+    return [int(v) for v in value.split(",")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl escaping benchmark")
+    parser.add_argument("--beectl", required=True)
+    parser.add_argument("--runs", type=int, default=15)
+    parser.add_argument("--sizes", type=int_list, default=[1, 2, 4, 8, 16, 32],
+                        help="text sizes in MiB")
+    parser.add_argument("--threads", type=int_list, default=[1, 2, 4, 8])
+    args = parser.parse_args()
+
+    base_env = dict(os.environ)
+    for name in ("BEECTL_STATS", "BEECTL_JSON_THREADS"):
+        base_env.pop(name, None)
+    columns = [(str(n), dict(base_env, BEECTL_JSON_THREADS=str(n)))
+               for n in args.threads]
+
+    print("escape: %8s  %s" % ("MiB", "  ".join("%9s" % name
+                                                for name, _ in columns)))
+    rng = random.Random(SEED)
+    for size in args.sizes:
+        request = make_request(rng, size << 20)
+        samples = {name: [] for name, _ in columns}
+        # Alternate the columns, so that all of them see the same state of
+        # the machine
+        for _ in range(args.runs):
+            for name, env in columns:
+                samples[name].append(run(args.beectl, request, env))
+        print("escape: %8d  %s"
+              % (size, "  ".join("%6.1f ms" % statistics.median(samples[name])
+                                 for name, _ in columns)))
+
+
+if __name__ == "__main__":
+    main()
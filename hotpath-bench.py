@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# Hot path timing of beectl: request decoding and response encoding.
+#
+# Every request passes a large text through a `cat` filter, so the time
+# until the response arrives is dominated by read_browser_request(), the
+# parsing of the request, writing the file and make_response(). The spawn of
+# `cat` and the file system costs are the same for every build.
+#
+# With --baseline, the requests to the two builds alternate, so that both see
+# the same state of the machine. Compare a PGO build (CMAKE_BUILD_TYPE=PGO)
+# with a Release build:
+#
+#   hotpath-bench.py --beectl build-pgo/beectl --baseline build-release/beectl
+#
+# Usage:
+#   hotpath-bench.py --beectl PATH [--baseline PATH] [--runs N] [--size N]
+
+import argparse
+import json
+import os
+import random
+import statistics
+import struct
+import subprocess
+import sys
+import time
+
+SEED = 20190111
+
+SAMPLE_UNICODE = "ʳkʊs kuːn — ∮ E⋅da = Q, ∀x∈ℝ: ⌈x⌉ = −⌊−x⌋ ði ıntəˈnæʃənəl 🐝"
+SAMPLE_ESCAPES = '"quoted" back\\slash \t tab \r\n \x01\x1f\x08\x0c /'
+
+
+def make_text(rng, size, kind):
+    """Builds a text of approximately `size` characters"""
+    if kind == "ascii":
+        pieces = ["plain ascii words ", "More Words 0123456789.,", "\n"]
+    elif kind == "unicode":
+        pieces = [SAMPLE_UNICODE, "plain ascii words ", "\n"]
+    elif kind == "escapes":
+        pieces = [SAMPLE_ESCAPES, "plain ascii words ", "\n"]
+    else:  # mixed
+        pieces = [SAMPLE_UNICODE, SAMPLE_ESCAPES, "plain ascii words " * 4, "\n"]
+    out = []
+    n = 0
+    while n < size:
+        piece = rng.choice(pieces)
+        out.append(piece)
+        n += len(piece)
+    return "".join(out)
+
+
+def make_request(text):
+    # Browsers send the text as UTF-8 rather than \u escapes
+    request = {"text": text, "editor": "/bin/cat", "filter": True}
+    body = json.dumps(request, ensure_ascii=False).encode("utf-8")
+    return struct.pack("=I", len(body)) + body
+
+
+def run(beectl, request, env):
+    """Returns the nanoseconds from the launch until the response"""
+    start = time.perf_counter_ns()
+    proc = subprocess.run([beectl], input=request, stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL, env=env)
+    elapsed = time.perf_counter_ns() - start
+    if proc.returncode != 0 or len(proc.stdout) < 4:
+        sys.exit("hotpath: %s failed (exit %d)" % (beectl, proc.returncode))
+    return elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl hot path benchmark")
+    parser.add_argument("--beectl", required=True)
+    parser.add_argument("--baseline", help="build to compare with")
+    parser.add_argument("--runs", type=int, default=30)
+    parser.add_argument("--warmup", type=int, default=3,
+                        help="runs not measured")
+    parser.add_argument("--size", type=int, default=4 << 20,
+                        help="characters per text")
+    args = parser.parse_args()
+
+    env = dict(os.environ)
+    for name in ("BEECTL_STATS", "BEECTL_SIMD"):
+        env.pop(name, None)
+
+    builds = [args.beectl]
+    if args.baseline:
+        builds.append(args.baseline)
+
+    rng = random.Random(SEED)
+    for kind in ("ascii", "unicode", "escapes", "mixed"):
+        request = make_request(make_text(rng, args.size, kind))
+        samples = {b: [] for b in builds}
+        for i in range(args.warmup + args.runs):
+            for beectl in builds:
+                elapsed = run(beectl, request, env)
+                if i >= args.warmup:
+                    samples[beectl].append(elapsed / 1e6)
+
+        medians = [statistics.median(samples[b]) for b in builds]
+        line = "hotpath: %-8s %7.1f MB " % (kind, len(request) / 1e6)
+        line += "  ".join("%8.2f ms" % m for m in medians)
+        if len(medians) == 2:
+            line += "  %+6.1f%%" % ((medians[0] - medians[1]) / medians[1] * 100)
+        print(line)
+
+
+if __name__ == "__main__":
+    main()
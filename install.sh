@@ -36,19 +36,29 @@ install -D -m 0755 "$dir/$source_host_file" "$target_path" && \
 
 # Copy manifests into browser-specific directories
 json_patch="{\"path\":\"$target_path\"}"
-tmp_manifest_file='tmp-manifest.json'
-
-target_manifest_path="$chrome_target_manifest_dir/$target_manifest_file"
-./json-patch "$dir/$chrome_manifest_file" "$json_patch" > "$tmp_manifest_file" && \
-install -D -m 0644 "$tmp_manifest_file" "$target_manifest_path" && \
-  printf "Installed Chrome manifest into '%s'\n" "$target_manifest_path"
-
-target_manifest_path="$chromium_target_manifest_dir/$target_manifest_file"
-./json-patch "$dir/$chrome_manifest_file" "$json_patch" > "$tmp_manifest_file" && \
-install -D -m 0644 "$tmp_manifest_file" "$target_manifest_path" && \
-  printf "Installed Chromium manifest into '%s'\n" "$target_manifest_path"
-
-target_manifest_path="$firefox_target_manifest_dir/$target_manifest_file"
-./json-patch "$dir/$firefox_manifest_file" "$json_patch" > "$tmp_manifest_file" && \
-install -D -m 0644 "$tmp_manifest_file" "$target_manifest_path" && \
-  printf "Installed Firefox manifest into '%s'\n" "$target_manifest_path"
+
+chrome_manifest_path="$chrome_target_manifest_dir/$target_manifest_file"
+chromium_manifest_path="$chromium_target_manifest_dir/$target_manifest_file"
+firefox_manifest_path="$firefox_target_manifest_dir/$target_manifest_file"
+
+# Patch copies of all manifests with a single process, so that an installed
+# manifest is never left unpatched or half-written
+staging_dir=$(mktemp -d)
+trap 'rm -rf "$staging_dir"' EXIT
+
+cp "$dir/$chrome_manifest_file" "$staging_dir/chrome.json"
+cp "$dir/$chromium_manifest_file" "$staging_dir/chromium.json"
+cp "$dir/$firefox_manifest_file" "$staging_dir/firefox.json"
+
+./json-patch -i \
+  "$staging_dir/chrome.json" "$json_patch" \
+  "$staging_dir/chromium.json" "$json_patch" \
+  "$staging_dir/firefox.json" "$json_patch"
+
+install -D -m 0644 "$staging_dir/chrome.json" "$chrome_manifest_path"
+install -D -m 0644 "$staging_dir/chromium.json" "$chromium_manifest_path"
+install -D -m 0644 "$staging_dir/firefox.json" "$firefox_manifest_path"
+
+printf "Installed Chrome manifest into '%s'\n" "$chrome_manifest_path"
+printf "Installed Chromium manifest into '%s'\n" "$chromium_manifest_path"
+printf "Installed Firefox manifest into '%s'\n" "$firefox_manifest_path"
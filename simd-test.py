@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+# Checks the vector kernels of beectl byte for byte against the scalar path.
+#
+# The string scan of the request, the escaping of the response and the UTF-8
+# validation have SSE2 and AVX2 kernels (see src/simd.h). Every case
+# runs once per instruction set, limited with BEECTL_SIMD, and the responses
+# must be identical to the one of the scalar path:
+#
+# - texts with a character to escape or a non-ASCII character at every
+#   offset around the vector widths, passed through a `cat` filter;
+# - invalid and truncated UTF-8 sequences at every offset, printed by the
+#   filter, so that only the output side sees them;
+# - large random texts, which are escaped in parallel (BEECTL_JSON_THREADS).
+#
+# For valid texts, the response must also decode to the text sent.
+#
+# Usage:
+#   simd-test.py --beectl PATH [--jobs N]
+
+import argparse
+import concurrent.futures
+import json
+import os
+import platform
+import random
+import struct
+import subprocess
+import sys
+
+SEED = 20190111
+
+# Covers two 32-byte vectors and the tails after them
+MAX_OFFSET = 70
+
+SPECIALS = ['"', "\\", "\x01", "\x1f", "\x7f", "/", "\t", "\n", "é",
+            "€", "\U0001f600", " ", '\\"', '"\\']
+
+INVALID = [b"\xff", b"\xc3", b"\xe2\x82", b"\xc0\xaf", b"\xed\xa0\x80",
+           b"\xf4\x90\x80\x80"]
+
+
+def levels():
+    """BEECTL_SIMD values; None is the best instruction set of the CPU"""
+    if platform.machine().lower() in ("x86_64", "amd64", "i386", "i686"):
+        return ["scalar", "sse2", "avx2"]
+    return ["scalar", None]
+
+
+def frame(obj):
+    body = json.dumps(obj).encode("utf-8")
+    return struct.pack("=I", len(body)) + body
+
+
+def cat_case(text):
+    return frame({"text": text, "editor": "/bin/cat", "filter": True}), text
+
+
+def printf_case(data):
+    # printf(1) understands octal escapes of any byte
+    fmt = "".join(chr(b) if chr(b).isalnum() else "\\%03o" % b for b in data)
+    return (frame({"text": "", "editor": "/bin/sh",
+                   "args": ["-c", "printf '%s'" % fmt], "filter": True}),
+            None)
+
+
+def cases():
+    """Yields (name, request, expected text or None)"""
+    for special in SPECIALS:
+        for offset in range(MAX_OFFSET):
+            text = "a" * offset + special + "b" * (MAX_OFFSET - offset)
+            yield ("%r at %d" % (special, offset),) + cat_case(text)
+    for seq in INVALID:
+        for offset in range(MAX_OFFSET):
+            data = b"a" * offset + seq + b"b" * (MAX_OFFSET - offset)
+            yield ("%r at %d" % (seq, offset),) + printf_case(data)
+
+    rng = random.Random(SEED)
+    alphabet = "abc xyz\n" * 8 + "".join(SPECIALS)
+    for size in (1 << 16, 1 << 20, 3 << 20):
+        text = "".join(rng.choice(alphabet) for _ in range(size))
+        yield ("random %d" % size,) + cat_case(text)
+
+
+def run(beectl, request, level):
+    env = dict(os.environ)
+    # The texts shorter than 2 MiB are still escaped by a single thread
+    env["BEECTL_JSON_THREADS"] = "4"
+    if level is None:
+        env.pop("BEECTL_SIMD", None)
+    else:
+        env["BEECTL_SIMD"] = level
+    proc = subprocess.run([beectl], input=request, stdout=subprocess.PIPE,
+                          stderr=subprocess.DEVNULL, env=env)
+    return proc.stdout
+
+
+def check(beectl, name, request, expected):
+    """Returns a list of failures"""
+    outputs = [(level, run(beectl, request, level)) for level in levels()]
+    reference = outputs[0][1]
+    failures = []
+
+    for level, output in outputs[1:]:
+        if output != reference:
+            failures.append("%s: %s differs from scalar" % (name, level))
+
+    if expected is not None:
+        try:
+            text = json.loads(reference[4:].decode("utf-8"))["text"]
+        except (ValueError, KeyError):
+            text = None
+        if text != expected:
+            failures.append("%s: the response doesn't match the text" % name)
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl SIMD kernel test")
+    parser.add_argument("--beectl", required=True)
+    parser.add_argument("--jobs", type=int, default=os.cpu_count() or 1)
+    args = parser.parse_args()
+
+    failures = []
+    num_cases = 0
+    with concurrent.futures.ThreadPoolExecutor(args.jobs) as pool:
+        futures = [pool.submit(check, args.beectl, *case) for case in cases()]
+        for future in futures:
+            num_cases += 1
+            failures.extend(future.result())
+
+    for failure in failures[:20]:
+        print("simd: FAILED: %s" % failure)
+    if failures:
+        sys.exit("simd: %d of %d cases failed" % (len(failures), num_cases))
+    print("simd: %d cases identical on %s"
+          % (num_cases, ", ".join(l or "native" for l in levels())))
+
+
+if __name__ == "__main__":
+    main()
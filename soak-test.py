@@ -0,0 +1,306 @@
+#!/usr/bin/env python3
+# Soak test for beectl: detects memory, descriptor and handle leaks and
+# latency drift over long sessions.
+#
+# 1. One session in which a fake editor (this script invoked with
+#    --fake-editor) saves the file --saves times, alternating in-place writes
+#    and write-to-temp-then-rename.
+# 2. --sessions back-to-back sessions with a single save each.
+# 3. Two sessions in which the editor idles, one with an --idle-mb request and
+#    one with an empty request. beectl releases the request once the editor
+#    is spawned, so its RSS while the editor is open must not depend on the
+#    size of the request.
+#
+# beectl writes a sample of its RSS, open descriptors and libuv handles to the
+# file named by BEECTL_STATS after every response and on exit (see
+# src/stats.h). The script compares the first and the last samples, measures
+# the save-to-response latency on its side, and checks that the session
+# directories are removed. It exits with status 1 if any of the thresholds is
+# exceeded.
+#
+# Usage:
+#   soak-test.py --beectl PATH [--saves N] [--sessions M] [--idle-mb N]
+#                [--wrapper "valgrind --leak-check=full --error-exitcode=99"]
+
+import argparse
+import glob
+import json
+import os
+import shlex
+import shutil
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+# Must exceed the debounce delay of the host, so that every save yields a
+# response
+SAVE_INTERVAL = 0.15
+
+# Delay before the first save; gives the host time to start watching
+FIRST_SAVE_DELAY = 0.4
+
+# Part of the samples taken as the beginning and the end of a run
+WINDOW = 0.1
+
+# How long the editor of the idle sessions stays open, and the RSS samples
+# taken meanwhile
+IDLE_TIME = 2.0
+IDLE_SAMPLES = 10
+
+
+def fake_editor(path, saves, log_path, idle):
+    """Saves the file `saves` times, logging the time of every save, or
+    idles for `idle` seconds"""
+    if idle > 0:
+        with open(log_path, "a") as log:
+            log.write("idle %.6f\n" % time.monotonic())
+        time.sleep(idle)
+        return
+    time.sleep(FIRST_SAVE_DELAY)
+    with open(log_path, "a") as log:
+        for i in range(saves):
+            data = ("save %d\n" % i).encode("utf-8") * 8
+            if i % 2:
+                tmp = path + ".swp"
+                with open(tmp, "wb") as f:
+                    f.write(data)
+                log.write("%d %.6f\n" % (i, time.monotonic()))
+                log.flush()
+                os.replace(tmp, path)
+            else:
+                log.write("%d %.6f\n" % (i, time.monotonic()))
+                log.flush()
+                with open(path, "wb") as f:
+                    f.write(data)
+            time.sleep(SAVE_INTERVAL)
+
+
+def frame(obj):
+    body = json.dumps(obj).encode("utf-8")
+    return struct.pack("=I", len(body)) + body
+
+
+def read_frames(stream, on_frame):
+    while True:
+        header = stream.read(4)
+        if len(header) < 4:
+            return
+        (n,) = struct.unpack("=I", header)
+        on_frame(time.monotonic(), json.loads(stream.read(n).decode("utf-8")))
+
+
+def run_session(args, env, saves, workdir):
+    """Runs a session; returns (exit code, save-to-response latencies)"""
+    log_path = os.path.join(workdir, "saves.log")
+    if os.path.exists(log_path):
+        os.remove(log_path)
+    request = {
+        "text": "",
+        "editor": sys.executable,
+        "args": [os.path.abspath(__file__), "--fake-editor",
+                 "--saves", str(saves), "--log", log_path, "--"],
+        "ext": "txt",
+    }
+    responses = {}
+
+    def on_frame(t, obj):
+        # The text of a response identifies the save
+        text = obj.get("text", "")
+        if text.startswith("save "):
+            responses.setdefault(int(text.split()[1]), t)
+
+    proc = subprocess.Popen(
+        shlex.split(args.wrapper) + [args.beectl],
+        stdin=subprocess.PIPE,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.DEVNULL,
+        env=env,
+    )
+    reader = threading.Thread(target=read_frames, args=(proc.stdout, on_frame))
+    reader.start()
+    proc.stdin.write(frame(request))
+    proc.stdin.close()
+    code = proc.wait()
+    reader.join()
+
+    saved = {}
+    if os.path.exists(log_path):
+        with open(log_path) as f:
+            for line in f:
+                i, t = line.split()
+                saved[int(i)] = float(t)
+    latencies = [(responses[i] - t) * 1000 for i, t in sorted(saved.items())
+                 if i in responses]
+    if len(latencies) != len(saved):
+        print("soak: %d of %d saves got no response" % (len(saved) - len(latencies), len(saved)))
+        code = code or 1
+    return code, latencies
+
+
+def read_rss_kb(pid):
+    with open("/proc/%d/status" % pid) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1])
+    return -1
+
+
+def idle_rss_kb(args, env, size, workdir):
+    """Runs a session with a request of `size` characters whose editor
+    idles; returns the median RSS of beectl meanwhile"""
+    log_path = os.path.join(workdir, "idle.log")
+    if os.path.exists(log_path):
+        os.remove(log_path)
+    text = ("idle text ʳkʊs \"quoted\"\n" * (size // 25 + 1))[:size]
+    request = {
+        "text": text,
+        "editor": sys.executable,
+        "args": [os.path.abspath(__file__), "--fake-editor", "--idle",
+                 str(IDLE_TIME), "--log", log_path, "--"],
+        "ext": "txt",
+    }
+    proc = subprocess.Popen([args.beectl], stdin=subprocess.PIPE,
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL, env=env)
+    proc.stdin.write(frame(request))
+    proc.stdin.close()
+
+    # The request has been released by the time the editor runs
+    deadline = time.monotonic() + 10
+    while not os.path.exists(log_path) and time.monotonic() < deadline:
+        time.sleep(0.01)
+    samples = []
+    while len(samples) < IDLE_SAMPLES and proc.poll() is None:
+        time.sleep(IDLE_TIME / 2 / IDLE_SAMPLES)
+        try:
+            samples.append(read_rss_kb(proc.pid))
+        except OSError:
+            break
+    proc.wait()
+    return statistics.median(samples) if samples else -1
+
+
+def load_samples(path):
+    with open(path) as f:
+        return [json.loads(line) for line in f if line.strip()]
+
+
+def head_tail(values):
+    n = max(1, int(len(values) * WINDOW))
+    return statistics.median(values[:n]), statistics.median(values[-n:])
+
+
+def check_growth(name, values, max_growth, failures):
+    """Compares the median of the first and the last samples"""
+    if len(values) < 2 or min(values) < 0:
+        print("soak: %-28s n/a" % name)
+        return
+    first, last = head_tail(values)
+    ok = last - first <= max_growth
+    print("soak: %-28s first %10.1f  last %10.1f  %s" % (name, first, last, "ok" if ok else "FAILED"))
+    if not ok:
+        failures.append(name)
+
+
+def session_dirs():
+    """Returns the session directories and their lock files (see
+    get_user_dir() in src/io.c)"""
+    runtime_dir = os.environ.get("XDG_RUNTIME_DIR")
+    if runtime_dir:
+        user_dir = os.path.join(runtime_dir, "beectl")
+    else:
+        user_dir = os.path.join(tempfile.gettempdir(), "beectl-%d" % os.getuid())
+    return set(glob.glob(os.path.join(user_dir, "session_*")))
+
+
+def soak(args):
+    failures = []
+    workdir = tempfile.mkdtemp(prefix="beectl-soak-")
+    stats_path = os.path.join(workdir, "stats.jsonl")
+    env = dict(os.environ)
+    env["BEECTL_STATS"] = stats_path
+    dirs_before = session_dirs()
+
+    # 1. Long session
+    print("soak: one session with %d saves" % args.saves)
+    code, latencies = run_session(args, env, args.saves, workdir)
+    if code != 0:
+        failures.append("long session exit code %d" % code)
+    samples = [s for s in load_samples(stats_path) if s["event"] == "response"]
+    check_growth("rss_kb per save", [s["rss_kb"] for s in samples], args.max_rss_kb, failures)
+    check_growth("fds per save", [s["fds"] for s in samples], 0, failures)
+    check_growth("handles per save", [s["handles"] for s in samples], 0, failures)
+    check_growth("host latency_ms", [s["latency_ms"] for s in samples], args.max_latency_ms, failures)
+    check_growth("save-to-response ms", latencies, args.max_latency_ms, failures)
+
+    # 2. Back-to-back sessions
+    os.remove(stats_path)
+    print("soak: %d back-to-back sessions" % args.sessions)
+    for i in range(args.sessions):
+        code, _ = run_session(args, env, 1, workdir)
+        if code != 0:
+            failures.append("session %d exit code %d" % (i, code))
+            break
+    exits = [s for s in load_samples(stats_path) if s["event"] == "exit"]
+    if len(exits) != args.sessions:
+        failures.append("%d of %d sessions wrote exit stats" % (len(exits), args.sessions))
+    check_growth("rss_kb at exit", [s["rss_kb"] for s in exits], args.max_rss_kb, failures)
+    check_growth("fds at exit", [s["fds"] for s in exits], 0, failures)
+    check_growth("handles at exit", [s["handles"] for s in exits], 0, failures)
+
+    # 3. Idle sessions
+    if args.idle_mb > 0 and os.path.exists("/proc/self/status"):
+        print("soak: idle sessions with %d MB and empty requests" % args.idle_mb)
+        env.pop("BEECTL_STATS", None)
+        large = idle_rss_kb(args, env, args.idle_mb << 20, workdir)
+        small = idle_rss_kb(args, env, 0, workdir)
+        ok = small >= 0 and large - small <= args.max_rss_kb
+        print("soak: %-28s empty %10.1f  large %10.1f  %s"
+              % ("idle rss_kb", small, large, "ok" if ok else "FAILED"))
+        if not ok:
+            failures.append("idle rss_kb")
+
+    leftover = session_dirs() - dirs_before
+    if leftover:
+        failures.append("session directories left: %s" % ", ".join(sorted(leftover)))
+
+    if failures:
+        sys.exit("soak: FAILED: %s\nsoak: stats kept in %s" % ("; ".join(failures), workdir))
+    shutil.rmtree(workdir)
+    print("soak: passed")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl soak test")
+    parser.add_argument("--beectl")
+    parser.add_argument("--saves", type=int, default=2000)
+    parser.add_argument("--sessions", type=int, default=1000)
+    parser.add_argument("--wrapper", default="",
+                        help="command prefix for beectl, e.g. valgrind")
+    parser.add_argument("--idle-mb", type=int, default=16,
+                        help="request size of the idle session, 0 to skip")
+    parser.add_argument("--max-rss-kb", type=float, default=1024,
+                        help="allowed RSS growth")
+    parser.add_argument("--max-latency-ms", type=float, default=50,
+                        help="allowed latency drift")
+    parser.add_argument("--fake-editor", action="store_true")
+    parser.add_argument("--idle", type=float, default=0)
+    parser.add_argument("--log")
+    parser.add_argument("file", nargs="?")
+    args = parser.parse_args()
+
+    if args.fake_editor:
+        fake_editor(args.file, args.saves, args.log, args.idle)
+        return
+
+    if not args.beectl:
+        parser.error("--beectl is required")
+    soak(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,88 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Limits on the requests of the browser.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "admission.h"
+#include "common.h"
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdint.h> /* UINT32_MAX SIZE_MAX */
+#include <stdlib.h> /* getenv, strtoull */
+#include <errno.h>
+#include <limits.h> /* UINT_MAX */
+
+static admission_limits_t limits;
+static bool limits_read = false;
+
+/* Returns the value of the environment variable `name`, or `def` if it is
+   not set or invalid. The value is capped at `max`. */
+static unsigned long long
+get_limit (const char *name, unsigned long long def, unsigned long long max)
+{
+  const char *value = getenv (name);
+  unsigned long long n;
+  char *end = NULL;
+
+  if (value == NULL || *value == '\0')
+    return def;
+
+  errno = 0;
+  n = strtoull (value, &end, 10);
+  if (errno || *end != '\0' || *value == '-')
+    {
+      elog_error ("Invalid %s value '%s'; using %llu\n", name, value, def);
+      return def;
+    }
+  return n > max ? max : n;
+}
+
+const admission_limits_t *
+admission_limits (void)
+{
+  if (limits_read)
+    return &limits;
+
+  limits.max_frame = (uint32_t) get_limit (ADMISSION_MAX_FRAME_ENV,
+                                           ADMISSION_MAX_FRAME_DEFAULT,
+                                           UINT32_MAX);
+  limits.max_depth = (unsigned) get_limit (ADMISSION_MAX_DEPTH_ENV,
+                                           ADMISSION_MAX_DEPTH_DEFAULT,
+                                           UINT_MAX);
+  limits.max_values = (size_t) get_limit (ADMISSION_MAX_VALUES_ENV,
+                                          ADMISSION_MAX_VALUES_DEFAULT,
+                                          SIZE_MAX);
+  limits.max_args = (unsigned) get_limit (ADMISSION_MAX_ARGS_ENV,
+                                          ADMISSION_MAX_ARGS_DEFAULT,
+                                          UINT_MAX);
+  limits.max_arg_len = (size_t) get_limit (ADMISSION_MAX_ARG_LEN_ENV,
+                                           ADMISSION_MAX_ARG_LEN_DEFAULT,
+                                           SIZE_MAX);
+  limits_read = true;
+
+  elog_debug ("%s: frame %u, depth %u, values %zu, args %u, arg length %zu\n",
+              __func__, limits.max_frame, limits.max_depth, limits.max_values,
+              limits.max_args, limits.max_arg_len);
+  return &limits;
+}
@@ -0,0 +1,78 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Limits on the requests of the browser.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_ADMISSION_H__
+#define __BEECTL_ADMISSION_H__
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t */
+
+/* Limits of the messages accepted from the browser (and from the editor
+   plugins), which bound the memory and the parse time spent on a
+   misbehaving page. Each can be overridden by an environment variable; 0
+   means no limit. */
+
+/* Body size of a native messaging frame, in bytes. The default leaves room
+   for the escaping of pastes of 100 MB. */
+#define ADMISSION_MAX_FRAME_ENV "BEECTL_MAX_FRAME"
+#define ADMISSION_MAX_FRAME_DEFAULT (256 * 1024 * 1024)
+
+/* Nesting depth of the arrays and objects of a request */
+#define ADMISSION_MAX_DEPTH_ENV "BEECTL_MAX_DEPTH"
+#define ADMISSION_MAX_DEPTH_DEFAULT 32
+
+/* Number of the values (array items and object members) of a request. Each
+   costs a node of the parser. */
+#define ADMISSION_MAX_VALUES_ENV "BEECTL_MAX_VALUES"
+#define ADMISSION_MAX_VALUES_DEFAULT 65536
+
+/* Number of the editor arguments and fields of a request. Each field adds
+   a file and an editor argument. */
+#define ADMISSION_MAX_ARGS_ENV "BEECTL_MAX_ARGS"
+#define ADMISSION_MAX_ARGS_DEFAULT 256
+
+/* Length of an editor argument, in bytes */
+#define ADMISSION_MAX_ARG_LEN_ENV "BEECTL_MAX_ARG_LEN"
+#define ADMISSION_MAX_ARG_LEN_DEFAULT 4096
+
+/* Codes of the error responses for the rejected requests */
+#define ADMISSION_FRAME_TOO_LARGE "frame_too_large"
+#define ADMISSION_TOO_DEEP "too_deep"
+#define ADMISSION_TOO_MANY_VALUES "too_many_values"
+#define ADMISSION_TOO_MANY_ARGS "too_many_args"
+#define ADMISSION_ARG_TOO_LONG "arg_too_long"
+
+typedef struct _admission_limits_t {
+  uint32_t max_frame;
+  unsigned max_depth;
+  size_t max_values;
+  unsigned max_args;
+  size_t max_arg_len;
+} admission_limits_t;
+
+/* Returns the limits. The environment is read on the first call. */
+const admission_limits_t *admission_limits (void);
+
+#endif /* __BEECTL_ADMISSION_H__ */
@@ -33,10 +33,22 @@
 #include "shell.h"
 #include "str.h"
 #include "io.h"
+#include "json.h"
+#include "filter.h"
+#include "buffer.h"
+#include "stats.h"
+#include "probes.h"
+#include "cache.h"
+#include "watch_uv.h"
+#include "ready.h"
+#include "admission.h"
 #include "basename.h"
 
 #include <stdlib.h> /* getenv, malloc, realloc, free */
-#include <string.h> /* strtok, strcmp, memcpy, printf */
+#ifdef __GLIBC__
+# include <malloc.h> /* malloc_trim */
+#endif
+#include <string.h> /* strtok_r, strcmp, memcpy, printf */
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdint.h> /* uint32_t UINT32_MAX */
@@ -56,18 +68,48 @@
 /* Used to coalesce multiple rapid file events into a single logical change. */
 #define FILE_CHANGE_DEBOUNCE_DELAY_MS 100
 
-/* Used to delay the watcher to avoid phantom editor open events. */
-#define FILE_WATCH_INITIAL_DELAY_MS 300
-
 uv_loop_t *loop;
 uv_fs_event_t fs_event;
-uv_timer_t debounce_timer;
-uv_timer_t watch_start_timer;
-bool debounce_timer_started = false;
-char *tmp_file_path = NULL;
-char *tmp_file_name = NULL;
+/* Debounces the file events into responses */
+static watch_uv_t watcher;
+/* Polls the files where the file events don't work */
+static uv_timer_t poll_timer;
 str_t tmp_file_dir = { 0 };
-static uv_timespec_t last_mtime = {0};
+/* The edited texts. A "text" request is a single field without ID; a
+   "fields" request has a file per item of the array.
+   The baselines of the fields are used to ignore the events that don't
+   change the content, e.g. when the editor touches or read-locks a file,
+   or creates swap or backup files. */
+static field_t *fields = NULL;
+static unsigned num_fields = 0;
+/* Set when the host is asked to terminate */
+static bool terminated = false;
+/* Stable location of the files if the request has a "cache_key" */
+static cache_entry_t cache_entry = { .lock_fd = -1 };
+/* Set if the request has "notify_ready": the browser is told when the
+   editor has opened the file */
+static bool notify_ready = false;
+
+/* Updates sent by the browser while the editor is open */
+static uv_pipe_t stdin_pipe;
+static frame_reader_t stdin_reader = { 0 };
+
+/* Work done on the startup thread while the main thread is waiting for the
+   browser request */
+typedef struct _session_prep_t {
+  uv_thread_t thread;
+  bool started;
+  /* Fallback editor, in case the request doesn't specify one */
+  char *alt_editor;
+  /* Temporary file without extension */
+  int tmp_fd;
+  char *tmp_path;
+  str_t tmp_dir;
+  /* Reads the requested editor into the page cache while the session is
+     being set up and the editor is starting */
+  uv_thread_t prefetch_thread;
+  bool prefetching;
+} session_prep_t;
 
 static void
 print_help ()
@@ -90,6 +132,9 @@ print_help ()
    in any directories listed in the PATH environment variable.
    The returned string must be freed.
 
+   Thread-safe: called concurrently from the main thread and the startup
+   thread (see prepare_session()).
+
    executable_size is the number of bytes in executable including the
    terminating null byte. */
 static char *
@@ -98,6 +143,7 @@ which (char *executable, size_t executable_size)
   char *dir = NULL;
   char *pathname = NULL;
   char *path = NULL;
+  char *saveptr = NULL;
   size_t pathname_size = 0;
   size_t dir_len = 0;
   size_t alloc_pathname_size = 256;
@@ -131,9 +177,9 @@ which (char *executable, size_t executable_size)
       return NULL;
     }
 
-  for (dir = strtok (path, PATH_DELIMITER);
+  for (dir = strtok_r (path, PATH_DELIMITER, &saveptr);
        dir != NULL;
-       dir = strtok (NULL, PATH_DELIMITER))
+       dir = strtok_r (NULL, PATH_DELIMITER, &saveptr))
     {
       dir_len = strlen (dir);
 
@@ -201,6 +247,71 @@ get_editor (const cJSON *obj)
 }
 
 
+/* Checks the shape of the JSON message `json` against the limits before it
+   is parsed: cJSON recurses into the nested values and allocates a node per
+   value. If `respond` is true, the browser gets an error response. Returns
+   false if the message must be rejected. */
+static bool
+admit_message (const char *json, size_t len, bool respond)
+{
+  const admission_limits_t *limits = admission_limits ();
+  json_shape_t shape;
+
+  json_measure (json, len, limits->max_depth, limits->max_values, &shape);
+
+  if (limits->max_depth && shape.depth > limits->max_depth)
+    {
+      elog_error ("Message nesting exceeds %u levels\n", limits->max_depth);
+      if (respond)
+        send_error_response (ADMISSION_TOO_DEEP,
+                             "The message nesting exceeds "
+                             ADMISSION_MAX_DEPTH_ENV);
+      return false;
+    }
+
+  if (limits->max_values && shape.values > limits->max_values)
+    {
+      elog_error ("Message has more than %zu values\n", limits->max_values);
+      if (respond)
+        send_error_response (ADMISSION_TOO_MANY_VALUES,
+                             "The message values exceed "
+                             ADMISSION_MAX_VALUES_ENV);
+      return false;
+    }
+
+  return true;
+}
+
+/* Checks the lengths of the editor arguments of the request `value` against
+   the limit before they are copied. Sends an error response and returns
+   false if it is exceeded. The number of the arguments is checked before
+   parsing (see main). */
+static bool
+check_editor_args (const cJSON *value)
+{
+  const admission_limits_t *limits = admission_limits ();
+  const cJSON *args_obj = cJSON_GetObjectItemCaseSensitive (value, "args");
+  const cJSON *arg_obj = NULL;
+
+  cJSON_ArrayForEach (arg_obj, args_obj)
+    {
+      const char *arg = cJSON_GetStringValue (arg_obj);
+
+      if (limits->max_arg_len && arg != NULL
+          && strlen (arg) > limits->max_arg_len)
+        {
+          elog_error ("Editor argument exceeds %zu bytes\n",
+                      limits->max_arg_len);
+          send_error_response (ADMISSION_ARG_TOO_LONG,
+                               "An editor argument exceeds "
+                               ADMISSION_MAX_ARG_LEN_ENV);
+          return false;
+        }
+    }
+
+  return true;
+}
+
 /* Reads the JSON value key "args", an array of command line arguments
    for executable specified via "editor" property.
    `value` represents the root JSON object: {"args":"...",...}
@@ -323,6 +434,25 @@ get_text_prop (const cJSON *value, unsigned int *value_len, const char* key)
 }
 
 
+/* Reads a non-negative number property value.
+   Returns `default_value` if the property is missing or not a number. */
+static uint64_t
+get_uint_prop (const cJSON *value, const char *key, uint64_t default_value)
+{
+  cJSON *num_obj = NULL;
+
+  if (unlikely (value == NULL || !cJSON_IsObject (value)))
+    return default_value;
+
+  num_obj = cJSON_GetObjectItemCaseSensitive (value, key);
+  if (num_obj == NULL || !cJSON_IsNumber (num_obj)
+      || num_obj->valuedouble < 0)
+    return default_value;
+
+  return (uint64_t) num_obj->valuedouble;
+}
+
+
 static inline char *
 get_text (const cJSON *value, unsigned int *value_len)
 {
@@ -371,15 +501,198 @@ get_alternative_editor ()
   return NULL;
 }
 
+/* Startup thread entry point. Prepares the parts of the session which don't
+   depend on the request: resolves the fallback editor, reads it into the page
+   cache, and creates the session directory with the temporary file. */
+static void
+prepare_session (void *arg)
+{
+  session_prep_t *prep = arg;
+
+  if (create_session_dir (&prep->tmp_dir))
+    prep->tmp_fd = open_tmp_file (&prep->tmp_path, &prep->tmp_dir, NULL, 0);
+
+  prep->alt_editor = get_alternative_editor ();
+  if (prep->alt_editor != NULL)
+    prefetch_file (prep->alt_editor);
+}
+
+/* Waits for the startup thread to finish */
+static void
+finish_session_prep (session_prep_t *prep)
+{
+  if (!prep->started)
+    return;
+
+  if (uv_thread_join (&prep->thread))
+    elog_error ("Failed to join the startup thread\n");
+  prep->started = false;
+}
+
+/* Prefetch thread entry point */
+static void
+prefetch_editor (void *arg)
+{
+  prefetch_file (arg);
+}
+
+/* Starts reading `editor` into the page cache. The main thread doesn't wait
+   for it: the spawn would have to read the file anyway. */
+static void
+start_editor_prefetch (session_prep_t *prep, const char *editor)
+{
+  prep->prefetching = !uv_thread_create (&prep->prefetch_thread,
+                                         prefetch_editor, (void *) editor);
+}
+
+/* Waits for the prefetch of the requested editor, which must be done before
+   the path is freed */
+static void
+finish_editor_prefetch (session_prep_t *prep)
+{
+  if (!prep->prefetching)
+    return;
+
+  if (uv_thread_join (&prep->prefetch_thread))
+    elog_error ("Failed to join the prefetch thread\n");
+  prep->prefetching = false;
+}
+
+/* Runs the command over the text instead of opening it in an editor, and
+   sends the output of the command to the browser.
+   Returns the exit code for the host. */
+static int
+run_filter (const cJSON *obj, char **args, const char *text, size_t text_len)
+{
+  filter_options_t options = { 0 };
+  char *output = NULL;
+  size_t output_len = 0;
+  int exit_code = EXIT_FAILURE;
+
+  options.timeout_ms = get_uint_prop (obj, "timeout",
+                                      FILTER_DEFAULT_TIMEOUT_MS);
+  /* The response length must fit into the frame header */
+  options.max_output = (size_t) get_uint_prop (obj, "max_output",
+                                               FILTER_DEFAULT_MAX_OUTPUT);
+  if (options.max_output > UINT32_MAX)
+    options.max_output = UINT32_MAX;
+
+  switch (filter_run (uv_default_loop (), args, text, text_len, &options,
+                      &output, &output_len))
+    {
+    case FILTER_OK:
+      break;
+    case FILTER_TIMED_OUT:
+      send_error_response (FILTER_ERROR_TIMEOUT,
+                           "The filter command didn't finish in time");
+      return EXIT_FAILURE;
+    case FILTER_OUTPUT_OVERFLOW:
+      send_error_response (FILTER_ERROR_OUTPUT_TOO_LARGE,
+                           "The filter command output exceeds max_output");
+      return EXIT_FAILURE;
+    default:
+      send_error_response (FILTER_ERROR_FAILED,
+                           "The filter command failed");
+      return EXIT_FAILURE;
+    }
+
+  elog_debug ("%s: filter produced %zu bytes\n", __func__, output_len);
+  if (send_text_response (NULL, output, output_len, true) == RESPONSE_SENT)
+    exit_code = EXIT_SUCCESS;
+  free (output);
+
+  return exit_code;
+}
+
+static void
+free_editor_args (char **args, unsigned num_args)
+{
+  for (unsigned i = 0; i < num_args; i++)
+    {
+      if (args[i] != NULL)
+        free (args[i]);
+    }
+  free (args);
+}
+
+static field_t *
+find_field_by_name (const char *filename)
+{
+  for (unsigned i = 0; i < num_fields; i++)
+    {
+      if (!strcmp (path_basename (fields[i].path), filename))
+        return &fields[i];
+    }
+  return NULL;
+}
+
+/* Returns the field with the ID, or the single field of a "text" request if
+   `id` is NULL */
+static field_t *
+find_field_by_id (const char *id)
+{
+  for (unsigned i = 0; i < num_fields; i++)
+    {
+      if (id == NULL ? fields[i].id == NULL
+          : fields[i].id != NULL && !strcmp (fields[i].id, id))
+        return &fields[i];
+    }
+  return NULL;
+}
+
+/* Sends the changed texts to the browser. If `final` is true, all texts are
+   sent as they are. */
+static response_status_t
+send_changes (bool final, void *arg)
+{
+  field_t *field = &fields[0];
+  response_status_t status;
+
+  if (field->id != NULL)
+    status = send_fields_response (fields, num_fields, final);
+  else
+    {
+      /* A single text is sent as {"text":"..."} */
+      status = send_file_response (field->path,
+                                   final ? NULL : &field->baseline,
+                                   final || field->incomplete_retries
+                                            >= MAX_INCOMPLETE_RETRIES);
+      if (status == RESPONSE_INCOMPLETE)
+        field->incomplete_retries++;
+      else
+        {
+          field->incomplete_retries = 0;
+          field->changed = false;
+        }
+    }
+
+  /* A change from the baseline comes from the editor, which must have
+     opened the file. Otherwise, the events are the host's own, e.g. the
+     write of a browser update, and so is the read. */
+  if (status == RESPONSE_SENT || status == RESPONSE_INCOMPLETE)
+    ready_touched ();
+  else
+    ready_rebase ();
+
+  return status;
+}
+
 static void
-on_file_change_debounced (uv_timer_t *handle)
+on_changes_sent (uint64_t latency_ns, void *arg)
 {
-  elog_debug ("%s: debounced file change confirmed\n", __func__);
-  debounce_timer_started = false;
+  stats_response (latency_ns);
+}
 
-  elog_debug ("%s: sending response to the browser\n", __func__);
-  if (tmp_file_path != NULL)
-    send_file_response (tmp_file_path);
+/* Called once the editor has first opened or read the files */
+static void
+on_editor_ready (uint64_t latency_ns, void *arg)
+{
+  elog_debug ("%s: editor ready %.3f ms after spawn\n", __func__,
+              latency_ns / 1e6);
+  BEECTL_PROBE1 (editor_ready, latency_ns);
+  stats_editor_ready (latency_ns);
+  if (notify_ready && !send_ready_response (latency_ns))
+    elog_error ("Failed to send the ready notification\n");
 }
 
 static void
@@ -388,7 +701,9 @@ on_file_change (uv_fs_event_t *handle,
                 int events,
                 int status)
 {
-  if (filename == NULL || strcmp (filename, tmp_file_name) != 0)
+  field_t *field = NULL;
+
+  if (filename == NULL || (field = find_field_by_name (filename)) == NULL)
     return;
 
   if (status < 0)
@@ -398,13 +713,250 @@ on_file_change (uv_fs_event_t *handle,
     }
 
   elog_debug ("Raw file event: %s (events: %d)\n", filename, events);
+  BEECTL_PROBE2 (file_event, filename, events);
+  field->changed = true;
+  watch_event (&watcher.watch);
+}
+
+/* Applies an update of the text sent by the browser during the session.
 
-  if (debounce_timer_started)
-    uv_timer_stop (&debounce_timer);
+   {"text":"..."} replaces the whole text;
+   {"text":"...","offset":N,"length":M} replaces M bytes at byte offset N.
+   In a "fields" session, the message also specifies the "id" of the field.
 
-  uv_timer_start (&debounce_timer, on_file_change_debounced,
-                  FILE_CHANGE_DEBOUNCE_DELAY_MS, 0);
-  debounce_timer_started = true;
+   The file baseline is set to the new content, so the events caused by the
+   write are not echoed back to the browser. */
+static void
+on_browser_message (char *body, uint32_t len, void *arg)
+{
+  cJSON *obj = NULL;
+  field_t *field = NULL;
+  char *text = NULL;
+  size_t text_len = 0;
+  bool applied = false;
+
+  elog_debug ("%s: received %u bytes\n", __func__, len);
+  if (fields == NULL || !admit_message (body, len, true))
+    return;
+
+  if (!json_extract_string_member (body, len, "text", &text, &text_len))
+    {
+      elog_error ("Ignoring a browser message without 'text'\n");
+      return;
+    }
+
+  obj = cJSON_ParseWithLength (body, len);
+  if (unlikely (obj == NULL || !cJSON_IsObject (obj)))
+    {
+      elog_error ("Failed parsing browser message\n");
+      goto _ret;
+    }
+
+  field = find_field_by_id (cJSON_GetStringValue (
+                             cJSON_GetObjectItemCaseSensitive (obj, "id")));
+  if (field == NULL)
+    {
+      elog_error ("Ignoring a browser message for an unknown field\n");
+      goto _ret;
+    }
+
+  /* Send the editor's change waiting for the debounce delay, so that it
+     isn't lost when the file is overwritten */
+  watch_flush (&watcher.watch);
+
+  if (cJSON_GetObjectItemCaseSensitive (obj, "offset") != NULL)
+    applied = file_replace_range (field->path,
+                                  (size_t) get_uint_prop (obj, "offset", 0),
+                                  (size_t) get_uint_prop (obj, "length", 0),
+                                  text, text_len, &field->baseline);
+  else
+    applied = file_replace_text (field->path, text, text_len,
+                                 &field->baseline);
+  if (!applied)
+    elog_error ("Failed to apply the update from the browser\n");
+  /* The write must not be taken for the editor opening the file */
+  ready_rebase ();
+
+_ret:
+  if (obj != NULL) cJSON_Delete (obj);
+  free (text);
+}
+
+/* Sends a buffer pushed by an editor plugin to the browser right away,
+   without waiting for the file to be saved.
+
+   {"text":"..."} carries the buffer of a "text" session;
+   {"id":"...","text":"..."} carries the buffer of a field.
+
+   The baseline is updated, so the file watcher doesn't send the content
+   again when the buffer is saved. */
+static void
+on_buffer_update (char *body, uint32_t len)
+{
+  cJSON *obj = NULL;
+  field_t *field = NULL;
+  char *text = NULL;
+  size_t text_len = 0;
+  uint64_t hash = 0;
+
+  elog_debug ("%s: received %u bytes\n", __func__, len);
+  if (fields == NULL)
+    return;
+  /* The plugin runs in the editor, which has the file open */
+  ready_touched ();
+  if (!admit_message (body, len, false))
+    return;
+
+  if (!json_extract_string_member (body, len, "text", &text, &text_len))
+    {
+      elog_error ("Ignoring a buffer update without 'text'\n");
+      return;
+    }
+
+  obj = cJSON_ParseWithLength (body, len);
+  if (unlikely (obj == NULL || !cJSON_IsObject (obj)))
+    {
+      elog_error ("Failed parsing buffer update\n");
+      goto _ret;
+    }
+
+  field = find_field_by_id (cJSON_GetStringValue (
+                             cJSON_GetObjectItemCaseSensitive (obj, "id")));
+  if (field == NULL)
+    {
+      elog_error ("Ignoring a buffer update for an unknown field\n");
+      goto _ret;
+    }
+
+  /* A save waiting for the debounce delay is older than the buffer. Send
+     it now, so that it doesn't follow the buffer and revert the browser to
+     the saved text. */
+  watch_flush (&watcher.watch);
+
+  hash = str_hash (text, text_len);
+  if (field->baseline.valid && field->baseline.size == text_len
+      && field->baseline.hash == hash)
+    goto _ret;
+
+  if (send_text_response (field->id, text, text_len, true) == RESPONSE_SENT)
+    file_baseline_set (&field->baseline, text, text_len);
+
+_ret:
+  if (obj != NULL) cJSON_Delete (obj);
+  free (text);
+}
+
+/* Returns a copy of the environment of the host with `name` set to `value`.
+   The result must be freed with free_env(). */
+static char **
+make_env (const char *name, const char *value)
+{
+  uv_env_item_t *items = NULL;
+  int count = 0;
+  char **env = NULL;
+  int n = 0;
+
+  if (uv_os_environ (&items, &count) != 0)
+    return NULL;
+
+  env = calloc ((size_t) count + 2, sizeof (char *));
+  if (unlikely (env == NULL))
+    {
+      perror ("calloc");
+      goto _ret;
+    }
+
+  for (int i = 0; i <= count; i++)
+    {
+      const char *item_name = i < count ? items[i].name : name;
+      const char *item_value = i < count ? items[i].value : value;
+      size_t size;
+
+      if (i < count && !strcmp (item_name, name))
+        continue;
+
+      size = strlen (item_name) + 1 + strlen (item_value) + 1;
+      if (unlikely ((env[n] = malloc (size)) == NULL))
+        {
+          perror ("malloc");
+          break;
+        }
+      snprintf (env[n++], size, "%s=%s", item_name, item_value);
+    }
+
+_ret:
+  uv_os_free_environ (items, count);
+  return env;
+}
+
+static void
+free_env (char **env)
+{
+  for (char **p = env; *p != NULL; p++)
+    free (*p);
+  free (env);
+}
+
+static void
+on_stdin_alloc (uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+  size_t avail = 0;
+
+  buf->base = frame_reader_reserve (&stdin_reader, suggested_size, &avail);
+  buf->len = buf->base != NULL ? avail : 0;
+}
+
+static void
+on_stdin_read (uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+  if (nread > 0)
+    {
+      if (frame_reader_consume (&stdin_reader, (size_t) nread,
+                                on_browser_message, NULL) > 0)
+        send_error_response (ADMISSION_FRAME_TOO_LARGE,
+                             "An update exceeds " ADMISSION_MAX_FRAME_ENV);
+      return;
+    }
+  if (nread == 0)
+    return;
+
+  /* The browser doesn't send updates anymore; the editor session goes on */
+  if (nread != UV_EOF)
+    elog_error ("Failed to read from stdin: %s\n", uv_strerror (nread));
+  else
+    elog_debug ("%s: stdin closed\n", __func__);
+  uv_close ((uv_handle_t *) stream, NULL);
+}
+
+/* Starts reading updates from the browser. The requests which follow the
+   initial one are applied to the temporary file. */
+static void
+start_browser_updates (void)
+{
+  int res;
+
+  if (uv_guess_handle (STDIN_FILENO) != UV_NAMED_PIPE)
+    {
+      elog_debug ("%s: stdin is not a pipe; updates are disabled\n",
+                  __func__);
+      return;
+    }
+
+  uv_pipe_init (loop, &stdin_pipe, 0);
+  res = uv_pipe_open (&stdin_pipe, STDIN_FILENO);
+  if (res == 0)
+    res = uv_read_start ((uv_stream_t *) &stdin_pipe, on_stdin_alloc,
+                         on_stdin_read);
+  if (res < 0)
+    {
+      elog_error ("Failed to read updates from stdin: %s\n",
+                  uv_strerror (res));
+      uv_close ((uv_handle_t *) &stdin_pipe, NULL);
+      return;
+    }
+
+  /* The session ends with the editor */
+  uv_unref ((uv_handle_t *) &stdin_pipe);
 }
 
 /* Editor process exit callback */
@@ -414,43 +966,84 @@ on_editor_process_exit (uv_process_t *req,
                  int term_signal)
 {
   elog_debug ("editor process exited with status %" PRId64 "\n", exit_status);
+  ready_stop ();
+  stats_editor_exit (exit_status, term_signal);
   uv_fs_event_stop (&fs_event);
   uv_close ((uv_handle_t *)req, NULL);
   uv_stop (loop);
 }
 
+/* Termination signal callback. Leaves the event loop, so that the session
+   directory gets removed. */
+static void
+on_terminate_signal (uv_signal_t *handle, int signum)
+{
+  elog_debug ("%s: received signal %d\n", __func__, signum);
+  terminated = true;
+  uv_stop (loop);
+}
+
 static void
-poll_tmp_file (uv_timer_t *handle)
+poll_field_files (uv_timer_t *handle)
 {
   uv_fs_t stat_req;
   uv_timespec_t mtime;
+  bool changed = false;
   int rc = -1;
 
-  rc = uv_fs_stat (loop, &stat_req, tmp_file_path, NULL);
-  if (rc < 0)
+  for (unsigned i = 0; i < num_fields; i++)
     {
-      elog_error ("uv_fs_stat failed: %s\n", uv_strerror (rc));
+      field_t *field = &fields[i];
+
+      rc = uv_fs_stat (loop, &stat_req, field->path, NULL);
+      if (rc < 0)
+        {
+          elog_error ("uv_fs_stat failed: %s\n", uv_strerror (rc));
+          uv_fs_req_cleanup (&stat_req);
+          continue;
+        }
+
+      mtime = stat_req.statbuf.st_mtim;
       uv_fs_req_cleanup (&stat_req);
-      return;
+
+      if (mtime.tv_sec != field->mtime_sec
+          || mtime.tv_nsec != field->mtime_nsec)
+        {
+          field->mtime_sec = mtime.tv_sec;
+          field->mtime_nsec = mtime.tv_nsec;
+          elog_debug ("Polling detected file change: %s\n", field->path);
+          field->changed = true;
+        }
+      /* An incomplete file stays changed, and is read again on the next
+         tick */
+      changed |= field->changed;
     }
 
-  mtime = stat_req.statbuf.st_mtim;
-  uv_fs_req_cleanup (&stat_req);
+  watch_poll (&watcher.watch, changed);
+}
 
-  if (mtime.tv_sec != last_mtime.tv_sec || mtime.tv_nsec != last_mtime.tv_nsec)
-    {
-      last_mtime = mtime;
-      elog_debug ("Polling detected file change: %s\n", tmp_file_path);
-      send_file_response (tmp_file_path);
-    }
+/* Checks the files for changes periodically */
+static void
+start_polling (void)
+{
+  int res = uv_timer_init (loop, &poll_timer);
+
+  if (res == 0)
+    res = uv_timer_start (&poll_timer, poll_field_files,
+                          FILE_CHANGE_DEBOUNCE_DELAY_MS,
+                          FILE_CHANGE_DEBOUNCE_DELAY_MS);
+  if (res < 0)
+    elog_error ("Failed to start polling: %s\n", uv_strerror (res));
 }
 
+/* Starts watching the temporary files for changes */
 static void
-start_file_watch_cb (uv_timer_t *timer)
+start_file_watch (void)
 {
   int res = -1;
 
-  /* Watch the directory of the temp file because many editors such as
+  /* Watch the directory of the temp file (private to this session) because
+     many editors such as
    *vim and code don't modify the inode of the file; instead, they write the
    updated content to a temporary file, delete the original, rename the new
    file to the original name (inode is destroyed and not being watched). */
@@ -469,28 +1062,184 @@ start_file_watch_cb (uv_timer_t *timer)
       elog_error ("Failed to start fs_event: %s; "
                   "falling back to polling\n",
                   uv_strerror (res));
-      uv_timer_start (&debounce_timer,
-                      poll_tmp_file,
-                      FILE_CHANGE_DEBOUNCE_DELAY_MS,
-                      FILE_CHANGE_DEBOUNCE_DELAY_MS);
+      start_polling ();
     }
 #else
   elog_debug ("Using polling for file changes on macOS\n");
-  uv_timer_start (&debounce_timer,
-                  poll_tmp_file,
-                  FILE_CHANGE_DEBOUNCE_DELAY_MS,
-                  FILE_CHANGE_DEBOUNCE_DELAY_MS);
+  start_polling ();
 #endif
 
-  elog_debug ("Started watching file: %s\n", tmp_file_path);
-  uv_timer_stop (timer);
-  uv_close ((uv_handle_t *) timer, NULL);
+  elog_debug ("Started watching files in %s\n", tmp_file_dir.name);
+}
+
+/* Writes the initial content of a field into the file open as `fd`, and
+   closes the file */
+static bool
+write_field_file (field_t *field, int fd, const char *text, size_t len)
+{
+  elog_debug ("writing %zu bytes to %s (fd = %d)\n", len, field->path, fd);
+  if (write (fd, text, len) != (ssize_t) len)
+    {
+      perror ("Temporary file is not writable");
+      close (fd);
+      return false;
+    }
+  if (unlikely (close (fd)))
+    {
+      perror ("close");
+      return false;
+    }
+
+  file_baseline_set (&field->baseline, text, len);
+  BEECTL_PROBE2 (tmpfile_created, field->path, len);
+  return true;
+}
+
+/* Creates the file of the field at its path in the cache entry, or in the
+   session directory */
+static bool
+create_field_file (field_t *field, const char *text, size_t len,
+                   const char *ext, size_t ext_len)
+{
+  int fd = -1;
+
+  if (cache_entry.lock_fd != -1)
+    {
+      field->path = cache_file_path (&cache_entry, field->id, ext, ext_len);
+      if (field->path == NULL
+          || !cache_write_file (field->path, text, len, &field->baseline))
+        return false;
+      BEECTL_PROBE2 (tmpfile_created, field->path, len);
+      return true;
+    }
+
+  fd = open_tmp_file (&field->path, &tmp_file_dir, ext, ext_len);
+  if (fd == -1)
+    return false;
+  elog_debug ("opened file (%s)\n", field->path);
+  return write_field_file (field, fd, text, len);
+}
+
+/* Writes the text of a "text" request into the temporary file created on
+   the startup thread, or into a new one */
+static bool
+create_text_file (session_prep_t *prep, const char *text, unsigned text_len,
+                  const char *ext, unsigned ext_len)
+{
+  int fd = -1;
+  field_t *field = NULL;
+
+  fields = calloc (1, sizeof (*fields));
+  if (unlikely (fields == NULL))
+    {
+      perror ("calloc");
+      return false;
+    }
+  num_fields = 1;
+  field = &fields[0];
+
+  if (cache_entry.lock_fd != -1)
+    {
+      if (!create_field_file (field, text, text_len, ext, ext_len))
+        {
+          elog_error ("Failed to write the cached file\n");
+          return false;
+        }
+      return true;
+    }
+
+  /* Take over the temporary file created on the startup thread */
+  fd = prep->tmp_fd;
+  field->path = prep->tmp_path;
+  tmp_file_dir = prep->tmp_dir;
+  prep->tmp_fd = -1;
+  prep->tmp_path = NULL;
+  memset (&prep->tmp_dir, 0, sizeof (prep->tmp_dir));
+
+  if (fd != -1 && ext_len && !add_tmp_file_ext (&field->path, ext, ext_len))
+    {
+      close (fd);
+      fd = -1;
+      remove_file (field->path);
+      free (field->path);
+      field->path = NULL;
+    }
+  if (fd == -1
+      && (tmp_file_dir.name != NULL || create_session_dir (&tmp_file_dir)))
+    fd = open_tmp_file (&field->path, &tmp_file_dir, ext, ext_len);
+  if (fd == -1)
+    {
+      elog_error ("Failed to open temporary file\n");
+      return false;
+    }
+  elog_debug ("opened file (%s)\n", field->path);
+
+  return write_field_file (field, fd, text, text_len);
+}
+
+/* Writes the items of the "fields" array, {"id":"...","text":"...",
+   "ext":"..."}, into files in the session directory. `ext` is the default
+   extension. */
+static bool
+create_field_files (const cJSON *fields_obj, const char *ext,
+                    unsigned ext_len)
+{
+  const cJSON *item = NULL;
+
+  fields = calloc (cJSON_GetArraySize (fields_obj), sizeof (*fields));
+  if (unlikely (fields == NULL))
+    {
+      perror ("calloc");
+      return false;
+    }
+
+  cJSON_ArrayForEach (item, fields_obj)
+    {
+      field_t *field = &fields[num_fields];
+      const char *id = cJSON_GetStringValue (
+        cJSON_GetObjectItemCaseSensitive (item, "id"));
+      const char *text = cJSON_GetStringValue (
+        cJSON_GetObjectItemCaseSensitive (item, "text"));
+      const char *field_ext = cJSON_GetStringValue (
+        cJSON_GetObjectItemCaseSensitive (item, "ext"));
+
+      if (id == NULL)
+        {
+          elog_error ("Field %u has no 'id'\n", num_fields);
+          return false;
+        }
+      if (find_field_by_id (id) != NULL)
+        {
+          elog_error ("Duplicate field id '%s'\n", id);
+          return false;
+        }
+      if (text == NULL)
+        text = "";
+      if (field_ext == NULL)
+        field_ext = ext;
+
+      field->id = strdup (id);
+      if (unlikely (field->id == NULL))
+        {
+          perror ("strdup");
+          return false;
+        }
+      num_fields++;
+
+      if (!create_field_file (field, text, strlen (text), field_ext,
+                              field_ext != NULL ? strlen (field_ext) : 0))
+        {
+          elog_error ("Failed to create the file for field '%s'\n", id);
+          return false;
+        }
+    }
+
+  return true;
 }
 
 int
 main (int argc, char *argv[])
 {
-  int fd = -1;
   int exit_code = EXIT_SUCCESS;
   int i = 0;
   int res = -1;
@@ -499,15 +1248,39 @@ main (int argc, char *argv[])
   unsigned editor_args_num = 0;
   char *text = NULL;
   unsigned text_len = 0;
+  size_t extracted_len = 0;
   char *ext = NULL;
   unsigned ext_len = 0;
+  char *encoding = NULL;
+  unsigned encoding_len = 0;
+  char *cache_key = NULL;
+  unsigned cache_key_len = 0;
   char *json_text = NULL;
   uint32_t json_size = 0;
   cJSON *obj = NULL;
   const char *error = NULL;
-  unsigned num_reserved_args = 1 /* tmp_file_path */;
+  unsigned num_reserved_args = 1 /* temporary file */;
+  bool filter = false;
+  const cJSON *fields_obj = NULL;
+  bool open_dir = false;
+  bool buffer_socket = false;
+  char *buffer_socket_path = NULL;
+  char **editor_env = NULL;
   uv_process_t child_proc;
   uv_process_options_t proc_options = { 0 };
+  session_prep_t prep = { .tmp_fd = -1 };
+#ifndef NDEBUG
+  uint64_t start_time = uv_hrtime ();
+  uint64_t request_time = 0;
+#endif
+  struct {
+    uv_signal_t handle;
+    int signum;
+  } term_signals[] = {
+    { .signum = SIGINT },
+    { .signum = SIGTERM },
+    { .signum = SIGHUP },
+  };
 
   for (i = 0; i < argc; ++i)
     {
@@ -541,35 +1314,116 @@ main (int argc, char *argv[])
   SET_BINARY_MODE (STDIN_FILENO);
   SET_BINARY_MODE (STDOUT_FILENO);
 
+  /* Also opens the debug log before the startup thread may need it */
+  elog_debug ("%s: starting\n", __func__);
+
+  /* Overlap the preparations with reading the request. The editor's cold start
+     is usually the dominant latency, so we want to spawn it as soon as
+     possible. */
+  if (uv_thread_create (&prep.thread, prepare_session, &prep) == 0)
+    prep.started = true;
+  else
+    prepare_session (&prep);
+
   if ((json_text = read_browser_request (&json_size)) == NULL)
-    return EXIT_FAILURE;
+    {
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+#ifndef NDEBUG
+  request_time = uv_hrtime ();
+#endif
+
+  if (!admit_message (json_text, json_size, true))
+    {
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+
+  /* Every field adds a file and an editor argument */
+  if (admission_limits ()->max_args
+      && (unsigned long long) json_count_array_member (
+           json_text, json_size, "args", admission_limits ()->max_args)
+         + json_count_array_member (json_text, json_size, "fields",
+                                    admission_limits ()->max_args)
+         > admission_limits ()->max_args)
+    {
+      elog_error ("Request has more than %u editor arguments and fields\n",
+                  admission_limits ()->max_args);
+      send_error_response (ADMISSION_TOO_MANY_ARGS,
+                           "The editor arguments and fields exceed "
+                           ADMISSION_MAX_ARGS_ENV);
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
 
-  obj = cJSON_Parse (json_text);
+  /* The text is usually the bulk of the request. Extract it with the
+     vectorized scanner, so that cJSON only parses the small remainder. */
+  if (json_extract_string_member (json_text, json_size, "text", &text,
+                                  &extracted_len))
+    text_len = (unsigned) extracted_len;
+
+  obj = cJSON_ParseWithLength (json_text, json_size);
   if (unlikely (obj == NULL))
     {
       error = cJSON_GetErrorPtr ();
       if (error != NULL)
         {
-          elog_debug ("Failed to parse json_text (%ld) `%s`\n", json_size, json_text);
+          elog_debug ("Failed to parse json_text (%ld) `%.*s`\n", json_size,
+                      (int)json_size, json_text);
           elog_error ("Failed parsing browser request: %s\n", error);
         }
       exit_code = EXIT_FAILURE;
       goto _ret;
     }
 
+  if (!check_editor_args (obj))
+    {
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+
+  /* In filter mode, "editor" is a non-interactive command which reads the
+     text from the standard input and writes the result to the standard
+     output */
+  filter = cJSON_IsTrue (cJSON_GetObjectItemCaseSensitive (obj, "filter"));
+  if (filter)
+    num_reserved_args = 0;
+
+  /* A "fields" request opens a file per field in a single editor. The editor
+     gets either the files or, with "open_dir", the session directory. */
+  if (!filter
+      && (fields_obj = cJSON_GetObjectItemCaseSensitive (obj, "fields")))
+    {
+      if (!cJSON_IsArray (fields_obj) || !cJSON_GetArraySize (fields_obj))
+        {
+          elog_error ("'fields' must be a non-empty array\n");
+          exit_code = EXIT_FAILURE;
+          goto _ret;
+        }
+      open_dir = cJSON_IsTrue (cJSON_GetObjectItemCaseSensitive (obj,
+                                                                 "open_dir"));
+      num_reserved_args = open_dir ? 1 : cJSON_GetArraySize (fields_obj);
+    }
+
   assert (editor == NULL);
   editor = get_editor (obj);
-  if (editor == NULL)
+  if (editor != NULL)
+    start_editor_prefetch (&prep, editor);
+
+  finish_session_prep (&prep);
+  if (editor == NULL && !filter)
     {
-      assert (editor == NULL);
-      editor = get_alternative_editor ();
+      editor = prep.alt_editor;
+      prep.alt_editor = NULL;
     }
   if (editor == NULL)
     {
-      elog_error ("Editor not found\n");
+      elog_error (filter ? "Filter command not found\n" : "Editor not found\n");
       exit_code = EXIT_FAILURE;
       goto _ret;
     }
+  BEECTL_PROBE1 (editor_resolved, editor);
 
   editor_args = get_editor_args (obj, &editor_args_num,
                                  num_reserved_args, editor);
@@ -580,7 +1434,8 @@ main (int argc, char *argv[])
       goto _ret;
     }
 
-  if ((text = get_text (obj, &text_len)) == NULL)
+  if (fields_obj == NULL && text == NULL
+      && (text = get_text (obj, &text_len)) == NULL)
     {
       elog_error ("Failed to read 'text' value\n");
       exit_code = EXIT_FAILURE;
@@ -590,64 +1445,131 @@ main (int argc, char *argv[])
   ext = get_ext (obj, &ext_len);
   elog_debug ("'ext': (%s) (len = %u)\n", ext, ext_len);
 
-  fd = open_tmp_file (&tmp_file_path, &tmp_file_dir, ext, ext_len);
-  if (fd == -1)
+  /* Encoding to assume if the editor saves the file in something other than
+     UTF-8 */
+  if ((encoding = get_text_prop (obj, &encoding_len, "encoding")) != NULL)
     {
-      elog_error ("Failed to open temporary file\n");
-      exit_code = EXIT_FAILURE;
-      goto _ret;
+      utf8_fallback_t fallback = utf8_fallback_from_name (encoding);
+
+      if (fallback == UTF8_FALLBACK_REPLACE)
+        elog_error ("Unsupported encoding '%s'; invalid UTF-8 sequences will "
+                    "be replaced\n", encoding);
+      set_response_fallback_encoding (fallback);
+      free (encoding);
     }
-  elog_debug ("opened file (%s)\n", tmp_file_path);
-  tmp_file_name = strdup (path_basename (tmp_file_path));
-  if (tmp_file_name == NULL)
+
+  /* Editor plugins may push the buffer over a socket */
+  buffer_socket = cJSON_IsTrue (cJSON_GetObjectItemCaseSensitive (
+                                  obj, "buffer_socket"));
+
+  /* The browser may show that the editor is up */
+  notify_ready = cJSON_IsTrue (cJSON_GetObjectItemCaseSensitive (
+                                 obj, "notify_ready"));
+
+  /* Logs and transcripts which only grow may be sent by the new bytes. The
+     fields are always sent whole. */
+  if (fields_obj == NULL
+      && cJSON_IsTrue (cJSON_GetObjectItemCaseSensitive (obj, "append")))
+    set_response_append (true);
+
+  if (filter)
     {
-      elog_error ("Failed to allocate temporary filename copy\n");
-      exit_code = EXIT_FAILURE;
+      /* No temporary file, editor or watchers */
+      exit_code = run_filter (obj, editor_args, text, text_len);
       goto _ret;
     }
-  editor_args[editor_args_num - num_reserved_args - 1] = tmp_file_path;
 
-  elog_debug ("writing %s (len = %u) to tmp file (fd = %d)\n",
-           text, text_len, fd);
-  if (write (fd, text, text_len) != text_len) {
-      perror ("Temporary file is not writable");
-      exit_code = EXIT_FAILURE;
-      goto _ret;
-  }
-  if (unlikely (close (fd)))
+  /* Edits of the same field reuse the files, so that the editor's caches
+     stay warm. If another session holds the entry, a session directory is
+     used as usual. */
+  if ((cache_key = get_text_prop (obj, &cache_key_len, "cache_key")) != NULL)
     {
-      perror ("close");
-      goto _ret;
-    }
-  fd = -1;
+      if (cache_open (&cache_entry, cache_key))
+        {
+          if (prep.tmp_fd != -1)
+            close (prep.tmp_fd);
+          prep.tmp_fd = -1;
+          if (prep.tmp_path != NULL)
+            {
+              remove_file (prep.tmp_path);
+              free (prep.tmp_path);
+              prep.tmp_path = NULL;
+            }
+          if (prep.tmp_dir.name != NULL)
+            remove_session_dir (prep.tmp_dir.name);
+          str_destroy (&prep.tmp_dir);
 
-  loop = uv_default_loop ();
+          tmp_file_dir.name = strdup (cache_entry.dir.name);
+          tmp_file_dir.size = cache_entry.dir.size;
+          if (unlikely (tmp_file_dir.name == NULL))
+            {
+              perror ("strdup");
+              exit_code = EXIT_FAILURE;
+              goto _ret;
+            }
+        }
+      free (cache_key);
+      cache_key = NULL;
+    }
 
-  res = uv_fs_event_init (loop, &fs_event);
-  if (unlikely (res < 0))
+  if (fields_obj != NULL)
     {
-      elog_error ("Failed to init fs_event: %s\n", uv_strerror (res));
-      exit_code = EXIT_FAILURE;
-      goto _ret;
+      /* The fields get files of their own in the session directory */
+      if (prep.tmp_fd != -1)
+        close (prep.tmp_fd);
+      prep.tmp_fd = -1;
+      if (prep.tmp_path != NULL)
+        {
+          remove_file (prep.tmp_path);
+          free (prep.tmp_path);
+          prep.tmp_path = NULL;
+        }
+      if (tmp_file_dir.name == NULL)
+        {
+          tmp_file_dir = prep.tmp_dir;
+          memset (&prep.tmp_dir, 0, sizeof (prep.tmp_dir));
+        }
+
+      if ((tmp_file_dir.name == NULL && !create_session_dir (&tmp_file_dir))
+          || !create_field_files (fields_obj, ext, ext_len))
+        {
+          exit_code = EXIT_FAILURE;
+          goto _ret;
+        }
+      fields_obj = NULL;
     }
-  res = uv_timer_init (loop, &debounce_timer);
-  if (unlikely (res < 0))
+  else if (!create_text_file (&prep, text, text_len, ext, ext_len))
     {
-      elog_error ("Failed to init debounce timer: %s\n", uv_strerror (res));
       exit_code = EXIT_FAILURE;
       goto _ret;
     }
-  res = uv_timer_init (loop, &watch_start_timer);
-  if (unlikely (res < 0))
+
+  for (unsigned j = 0; j < num_reserved_args; j++)
     {
-      elog_error ("Failed to init watch_start_timer: %s\n", uv_strerror (res));
-      exit_code = EXIT_FAILURE;
-      goto _ret;
+      char *arg = strdup (open_dir ? tmp_file_dir.name : fields[j].path);
+
+      if (unlikely (arg == NULL))
+        {
+          perror ("strdup");
+          exit_code = EXIT_FAILURE;
+          goto _ret;
+        }
+      editor_args[editor_args_num - num_reserved_args - 1 + j] = arg;
     }
-  /* Delay file watching to avoid getting events on the newly created file
-     which may happen if the editor touches or read-locks the file, triggers background
-     processes taht open the file, create swap or backup files sometimes modifying the mtime. */
-  uv_timer_start (&watch_start_timer, start_file_watch_cb, FILE_WATCH_INITIAL_DELAY_MS, 0);
+
+  /* The request is not needed anymore while the editor is open, which may
+     last for hours. Release it along with the heap pages it occupied. */
+  free (json_text);
+  json_text = NULL;
+  cJSON_Delete (obj);
+  obj = NULL;
+  free (text);
+  text = NULL;
+  free (ext);
+  ext = NULL;
+#ifdef __GLIBC__
+  malloc_trim (0);
+#endif
 
   if (unlikely (editor_args_num == 0 || editor_args[0] == NULL))
     {
@@ -656,22 +1578,96 @@ main (int argc, char *argv[])
       goto _ret;
     }
 
+  loop = uv_default_loop ();
+  stats_init (loop);
+
+  /* The path of the socket is passed to the editor in the environment. The
+     file watcher keeps working for editors without a plugin. */
+  if (buffer_socket
+      && (buffer_socket_path = buffer_channel_start (loop, tmp_file_dir.name,
+                                                     on_buffer_update))
+      && (editor_env = make_env (BUFFER_SOCKET_ENV, buffer_socket_path))
+         == NULL)
+    elog_error ("Failed to pass %s to the editor\n", BUFFER_SOCKET_ENV);
+
   proc_options.args = editor_args;
   proc_options.file = editor_args[0];
   proc_options.exit_cb = on_editor_process_exit;
   proc_options.flags = UV_PROCESS_WINDOWS_HIDE_CONSOLE; /* Hide the terminal window on Windows. */
   proc_options.stdio_count = 0;
   proc_options.cwd = NULL;
-  proc_options.env = NULL;
-
+  proc_options.env = editor_env;
+
+  /* The ready detection takes its baseline before the spawn: an editor may
+     open the file before uv_spawn() returns. */
+  if ((notify_ready || stats_enabled ())
+      && !ready_start (loop, fields, num_fields,
+                       open_dir ? tmp_file_dir.name : NULL,
+                       on_editor_ready, NULL))
+    elog_error ("Failed to detect when the editor is ready\n");
+
+  /* Spawn the editor as soon as the file is complete; the file watcher is
+     set up while it is starting. */
   elog_debug ("%s: spawning editor process\n", __func__);
   res = uv_spawn (loop, &child_proc, &proc_options);
+  if (editor_env != NULL)
+    {
+      free_env (editor_env);
+      editor_env = NULL;
+    }
   if (res < 0)
     {
       elog_error ("Failed to spawn editor process: %s\n", uv_strerror (res));
+      ready_stop ();
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+  ready_set_pid (child_proc.pid);
+  BEECTL_PROBE1 (editor_spawn, child_proc.pid);
+  stats_editor_start (editor_args[0]);
+  elog_debug ("%s: spawned editor %.3f ms after start, "
+              "%.3f ms after reading the request\n",
+              __func__,
+              (uv_hrtime () - start_time) / 1e6,
+              (uv_hrtime () - request_time) / 1e6);
+
+  res = uv_fs_event_init (loop, &fs_event);
+  if (unlikely (res < 0))
+    {
+      elog_error ("Failed to init fs_event: %s\n", uv_strerror (res));
       exit_code = EXIT_FAILURE;
       goto _ret;
     }
+  res = watch_uv_init (&watcher, loop, FILE_CHANGE_DEBOUNCE_DELAY_MS,
+                       send_changes, on_changes_sent, NULL);
+  if (unlikely (res < 0))
+    {
+      elog_error ("Failed to init debounce timer: %s\n", uv_strerror (res));
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+  /* Events which don't change the content are filtered out by comparing it
+     with the baseline, so the watch can start right away */
+  start_file_watch ();
+  start_browser_updates ();
+
+  /* Make sure the session directory is removed when the browser terminates
+     the host. The handles must not keep the loop alive. */
+  for (i = 0; i < (int) (sizeof (term_signals) / sizeof (term_signals[0])); i++)
+    {
+      uv_signal_init (loop, &term_signals[i].handle);
+      res = uv_signal_start (&term_signals[i].handle, on_terminate_signal,
+                             term_signals[i].signum);
+      if (res < 0)
+        elog_debug ("Failed to handle signal %d: %s\n",
+                    term_signals[i].signum, uv_strerror (res));
+      uv_unref ((uv_handle_t *) &term_signals[i].handle);
+    }
+
+  /* Clean up after crashed sessions while the editor is starting */
+  sweep_session_dirs ();
+  if (cache_entry.lock_fd != -1)
+    cache_sweep ();
 
   elog_debug ("%s: running event loop\n", __func__);
   uv_run (loop, UV_RUN_DEFAULT);
@@ -681,7 +1677,13 @@ main (int argc, char *argv[])
   if (uv_loop_alive (loop))
     uv_loop_close (loop);
 
-  if (unlikely (tmp_file_path == NULL || access (tmp_file_path, F_OK) != 0))
+  if (terminated)
+    {
+      exit_code = EXIT_FAILURE;
+      goto _ret;
+    }
+
+  if (unlikely (fields[0].id == NULL && access (fields[0].path, F_OK) != 0))
     {
       elog_error ("Temporary file was not found after editor exited\n");
       exit_code = EXIT_FAILURE;
@@ -689,30 +1691,53 @@ main (int argc, char *argv[])
     }
 
   elog_debug ("%s: sending response\n", __func__);
-  send_file_response (tmp_file_path);
+  watch_finish (&watcher.watch);
 
 _ret:
-  if (fd != -1) close (fd);
-  if (tmp_file_path != NULL)
-    remove_file (tmp_file_path);
-  if (tmp_file_name != NULL)
-    free (tmp_file_name);
+  finish_session_prep (&prep);
+  finish_editor_prefetch (&prep);
+  if (prep.tmp_fd != -1) close (prep.tmp_fd);
+  if (prep.tmp_path != NULL)
+    {
+      remove_file (prep.tmp_path);
+      free (prep.tmp_path);
+    }
+  if (prep.tmp_dir.name != NULL)
+    remove_session_dir (prep.tmp_dir.name);
+  str_destroy (&prep.tmp_dir);
+  if (prep.alt_editor != NULL) free (prep.alt_editor);
+  if (buffer_socket_path != NULL)
+    {
+      buffer_channel_stop ();
+      free (buffer_socket_path);
+    }
 
-  if (editor_args)
+  for (unsigned j = 0; fields != NULL && j < num_fields; j++)
     {
-      for (unsigned i = 0; i < editor_args_num; i++)
+      if (fields[j].path != NULL)
         {
-          if (editor_args[i] != NULL)
-            free (editor_args[i]);
+          /* The cached files are kept for the next session */
+          if (cache_entry.lock_fd == -1)
+            remove_file (fields[j].path);
+          free (fields[j].path);
         }
-      free (editor_args);
+      if (fields[j].id != NULL) free (fields[j].id);
     }
+  if (fields != NULL) free (fields);
+  if (tmp_file_dir.name != NULL && cache_entry.lock_fd == -1)
+    remove_session_dir (tmp_file_dir.name);
+  cache_close (&cache_entry);
+
+  if (editor_args)
+    free_editor_args (editor_args, editor_args_num);
   if (editor != NULL) free (editor);
   if (json_text != NULL) free (json_text);
   if (obj != NULL) cJSON_Delete (obj);
   if (text != NULL) free (text);
   if (ext != NULL) free (ext);
   str_destroy (&tmp_file_dir);
+  frame_reader_destroy (&stdin_reader);
+  stats_finish ();
 
   elog_debug ("%s exiting with exit_code = %d\n", __func__, exit_code);
   return exit_code;
@@ -0,0 +1,186 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Live buffer channel.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "buffer.h"
+#include "common.h"
+#include "io.h"
+
+#include <errno.h>
+#include <stdio.h>  /* snprintf */
+#include <stdlib.h> /* malloc, free */
+#include <string.h>
+
+#ifdef WINDOWS
+# define BUFFER_SOCKET_FORMAT "\\\\.\\pipe\\beectl-%ld-buffer"
+#else
+# define BUFFER_SOCKET_FORMAT "%s/buffer.sock"
+#endif
+
+typedef struct _buffer_client_t {
+  uv_pipe_t pipe;
+  frame_reader_t reader;
+} buffer_client_t;
+
+static uv_pipe_t server;
+static buffer_update_cb_t update_cb = NULL;
+/* Path of the socket while listening */
+static char *server_path = NULL;
+
+static void
+on_client_close (uv_handle_t *handle)
+{
+  buffer_client_t *client = handle->data;
+
+  frame_reader_destroy (&client->reader);
+  free (client);
+}
+
+static void
+on_client_alloc (uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+  buffer_client_t *client = handle->data;
+  size_t avail = 0;
+
+  buf->base = frame_reader_reserve (&client->reader, suggested_size, &avail);
+  buf->len = buf->base != NULL ? avail : 0;
+}
+
+static void
+on_frame (char *body, uint32_t len, void *arg)
+{
+  update_cb (body, len);
+}
+
+static void
+on_client_read (uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+  buffer_client_t *client = stream->data;
+
+  if (nread > 0)
+    {
+      frame_reader_consume (&client->reader, (size_t) nread, on_frame, NULL);
+      return;
+    }
+  if (nread == 0)
+    return;
+
+  if (nread != UV_EOF)
+    elog_error ("Failed to read from a buffer client: %s\n",
+                uv_strerror (nread));
+  elog_debug ("%s: buffer client disconnected\n", __func__);
+  uv_close ((uv_handle_t *) stream, on_client_close);
+}
+
+static void
+on_connection (uv_stream_t *stream, int status)
+{
+  buffer_client_t *client = NULL;
+  int res;
+
+  if (status < 0)
+    {
+      elog_error ("Buffer channel error: %s\n", uv_strerror (status));
+      return;
+    }
+
+  client = calloc (1, sizeof (*client));
+  if (unlikely (client == NULL))
+    {
+      perror ("calloc");
+      return;
+    }
+  uv_pipe_init (stream->loop, &client->pipe, 0);
+  client->pipe.data = client;
+
+  res = uv_accept (stream, (uv_stream_t *) &client->pipe);
+  if (res == 0)
+    res = uv_read_start ((uv_stream_t *) &client->pipe, on_client_alloc,
+                         on_client_read);
+  if (res < 0)
+    {
+      elog_error ("Failed to accept a buffer client: %s\n", uv_strerror (res));
+      uv_close ((uv_handle_t *) &client->pipe, on_client_close);
+      return;
+    }
+
+  elog_debug ("%s: buffer client connected\n", __func__);
+  /* The session ends with the editor */
+  uv_unref ((uv_handle_t *) &client->pipe);
+}
+
+char *
+buffer_channel_start (uv_loop_t *loop, const char *session_dir,
+                      buffer_update_cb_t cb)
+{
+  char path[512];
+  int n;
+  int res;
+
+#ifdef WINDOWS
+  n = snprintf (path, sizeof (path), BUFFER_SOCKET_FORMAT, (long) getpid ());
+#else
+  n = snprintf (path, sizeof (path), BUFFER_SOCKET_FORMAT, session_dir);
+#endif
+  if (n < 0 || (size_t) n >= sizeof (path))
+    return NULL;
+
+  update_cb = cb;
+  uv_pipe_init (loop, &server, 0);
+
+#ifndef WINDOWS
+  /* A socket left by an earlier session in the same cache entry */
+  unlink (path);
+#endif
+
+  res = uv_pipe_bind (&server, path);
+  if (res == 0)
+    res = uv_listen ((uv_stream_t *) &server, 4, on_connection);
+  if (res < 0)
+    {
+      elog_error ("Failed to listen on %s: %s\n", path, uv_strerror (res));
+      uv_close ((uv_handle_t *) &server, NULL);
+      return NULL;
+    }
+  uv_unref ((uv_handle_t *) &server);
+
+  elog_debug ("%s: listening on %s\n", __func__, path);
+  server_path = strdup (path);
+  return strdup (path);
+}
+
+void
+buffer_channel_stop (void)
+{
+  if (server_path == NULL)
+    return;
+
+  uv_close ((uv_handle_t *) &server, NULL);
+#ifndef WINDOWS
+  if (unlink (server_path) && errno != ENOENT)
+    elog_error ("Failed to remove %s: %s\n", server_path, strerror (errno));
+#endif
+  free (server_path);
+  server_path = NULL;
+}
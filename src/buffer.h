@@ -0,0 +1,56 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Live buffer channel header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_BUFFER_H__
+#define __BEECTL_BUFFER_H__
+
+#include <stdbool.h>
+#include <stdint.h> /* uint32_t */
+
+#include <uv.h>
+
+/* Environment variable which tells the editor the path of the socket */
+#define BUFFER_SOCKET_ENV "BEECTL_BUFFER_SOCKET"
+
+/* Called for every message pushed by a client. The body may be modified in
+   place. */
+typedef void (*buffer_update_cb_t) (char *body, uint32_t len);
+
+/* Starts listening for buffer updates on a socket private to the session:
+   a Unix socket in `session_dir`, or a named pipe on Windows.
+
+   Editor plugins connect to the socket, and send native messaging frames
+   (the 32-bit length followed by a JSON body) whenever the buffer changes.
+
+   On success, returns the path of the socket, which must be freed by the
+   caller. On error, returns NULL. */
+char *buffer_channel_start (uv_loop_t *loop, const char *session_dir,
+                            buffer_update_cb_t cb);
+
+/* Stops listening, and removes the socket from the session directory, which
+   may be a cache entry outliving the session */
+void buffer_channel_stop (void);
+
+#endif /* __BEECTL_BUFFER_H__ */
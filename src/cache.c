@@ -0,0 +1,530 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Stable file paths for edits of the same field.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "cache.h"
+#include "common.h"
+
+#include <ctype.h>  /* islower, isdigit, isxdigit */
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h> /* malloc, realloc, free, qsort */
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef WINDOWS
+# include <direct.h> /* _mkdir */
+# include <io.h>     /* _sopen_s, _chsize_s, _write, _close */
+# include <share.h>  /* _SH_DENYRW */
+#else
+# include <dirent.h>   /* opendir readdir closedir */
+# include <sys/file.h> /* flock */
+#endif
+
+/* Name of the lock file in an entry directory. Its modification time is the
+   time the entry was last used. */
+#define CACHE_LOCK_NAME ".lock"
+
+/* Longest field ID used as a file name as it is */
+#define CACHE_MAX_NAME_LEN 64
+
+/* Length of a hash used as a file name: 16 hexadecimal digits */
+#define CACHE_HASH_NAME_LEN 16
+
+/* Suffix of an entry directory being removed by cache_sweep() */
+#define CACHE_TRASH_SUFFIX ".trash"
+
+/* Name of the file of the text of a "text" request */
+#define CACHE_TEXT_NAME "text"
+
+typedef struct _cache_item_t {
+  char *path;
+  time_t mtime;
+} cache_item_t;
+
+static char *
+join_path (const char *dir, const char *name)
+{
+  size_t size = strlen (dir) + DIR_SEPARATOR_LEN + strlen (name) + 1;
+  char *path = malloc (size);
+
+  if (unlikely (path == NULL))
+    {
+      perror ("malloc");
+      return NULL;
+    }
+  snprintf (path, size, "%s%c%s", dir, DIR_SEPARATOR, name);
+  return path;
+}
+
+/* Returns the directory holding the entries, creating it if needed */
+static char *
+get_cache_root (void)
+{
+  str_t user_dir = { 0 };
+  char *root = NULL;
+
+  if (!get_user_dir (&user_dir))
+    return NULL;
+
+  root = join_path (user_dir.name, CACHE_DIR_NAME);
+  str_destroy (&user_dir);
+  if (root == NULL)
+    return NULL;
+
+#ifdef WINDOWS
+  if (_mkdir (root) == -1 && errno != EEXIST)
+#else
+  if (mkdir (root, 0700) == -1 && errno != EEXIST)
+#endif
+    {
+      elog_error ("Failed to create %s: %s\n", root, strerror (errno));
+      free (root);
+      return NULL;
+    }
+  return root;
+}
+
+/* Opens and locks the lock file of the entry in `dir` without waiting.
+   Returns the descriptor, or -1 if the entry is in use or can't be locked. */
+static int
+lock_entry (const char *dir)
+{
+  char *path = join_path (dir, CACHE_LOCK_NAME);
+  int fd = -1;
+
+  if (path == NULL)
+    return -1;
+
+#ifdef WINDOWS
+  /* The file can't be opened again while the exclusive share mode is in
+     effect */
+  if (_sopen_s (&fd, path, _O_RDWR | _O_CREAT | _O_BINARY, _SH_DENYRW,
+                _S_IREAD | _S_IWRITE) != 0)
+    fd = -1;
+#else
+  fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd != -1 && flock (fd, LOCK_EX | LOCK_NB) == -1)
+    {
+      close (fd);
+      fd = -1;
+    }
+#endif
+
+  free (path);
+  return fd;
+}
+
+/* Returns true if `fd` is still the lock file of the entry in `dir`.
+   cache_sweep() may have moved the entry away between the open and the
+   lock. */
+static bool
+is_lock_current (const char *dir, int fd)
+{
+#ifdef WINDOWS
+  /* An entry can't be moved while its lock file is open */
+  (void) dir;
+  (void) fd;
+  return true;
+#else
+  char *path = join_path (dir, CACHE_LOCK_NAME);
+  struct stat fd_st;
+  struct stat path_st;
+  bool current;
+
+  if (path == NULL)
+    return false;
+  current = fstat (fd, &fd_st) == 0 && stat (path, &path_st) == 0
+            && fd_st.st_dev == path_st.st_dev
+            && fd_st.st_ino == path_st.st_ino;
+  free (path);
+  return current;
+#endif
+}
+
+bool
+cache_open (cache_entry_t *entry, const char *key)
+{
+  char *root = NULL;
+  char name[17];
+  char pid[24];
+  int n;
+  bool ok = false;
+
+  entry->dir.name = NULL;
+  entry->lock_fd = -1;
+
+  if ((root = get_cache_root ()) == NULL)
+    return false;
+
+  snprintf (name, sizeof (name), "%016" PRIx64, str_hash (key, strlen (key)));
+  entry->dir.name = join_path (root, name);
+  if (entry->dir.name == NULL)
+    goto _ret;
+  entry->dir.size = strlen (entry->dir.name) + 1;
+
+#ifdef WINDOWS
+  if (_mkdir (entry->dir.name) == -1 && errno != EEXIST)
+#else
+  if (mkdir (entry->dir.name, 0700) == -1 && errno != EEXIST)
+#endif
+    {
+      elog_error ("Failed to create %s: %s\n", entry->dir.name,
+                  strerror (errno));
+      goto _ret;
+    }
+
+  entry->lock_fd = lock_entry (entry->dir.name);
+  if (entry->lock_fd == -1)
+    {
+      elog_debug ("%s: %s is in use by another session\n", __func__,
+                  entry->dir.name);
+      goto _ret;
+    }
+  if (!is_lock_current (entry->dir.name, entry->lock_fd))
+    {
+      elog_debug ("%s: %s has been removed meanwhile\n", __func__,
+                  entry->dir.name);
+      goto _ret;
+    }
+
+  /* Record the holder; this also marks the entry as recently used */
+  n = snprintf (pid, sizeof (pid), "%ld\n", (long) getpid ());
+#ifdef WINDOWS
+  if (_chsize_s (entry->lock_fd, 0) != 0
+      || _write (entry->lock_fd, pid, n) != n)
+#else
+  if (ftruncate (entry->lock_fd, 0) == -1
+      || write (entry->lock_fd, pid, n) != n)
+#endif
+    elog_debug ("%s: failed to update the lock file: %s\n", __func__,
+                strerror (errno));
+
+  elog_debug ("%s: using %s\n", __func__, entry->dir.name);
+  ok = true;
+
+_ret:
+  if (!ok)
+    cache_close (entry);
+  free (root);
+  return ok;
+}
+
+/* Returns true if a field ID can be used as a file name.
+
+   The IDs differ case-sensitively, but the file names may not (macOS,
+   Windows), so an ID with capital letters is hashed. So is an ID which
+   looks like a hash. */
+static bool
+is_safe_name (const char *id)
+{
+  size_t i;
+  bool hex = true;
+
+  if (*id == '\0' || *id == '.')
+    return false;
+  for (i = 0; id[i] != '\0'; i++)
+    {
+      const unsigned char c = id[i];
+
+      if (i >= CACHE_MAX_NAME_LEN)
+        return false;
+      if (!(islower (c) || isdigit (c)) && c != '-' && c != '_' && c != '.')
+        return false;
+      hex = hex && isxdigit (c);
+    }
+  return !hex || i != CACHE_HASH_NAME_LEN;
+}
+
+char *
+cache_file_path (const cache_entry_t *entry, const char *id,
+                 const char *ext, size_t ext_len)
+{
+  char hash[CACHE_HASH_NAME_LEN + 1];
+  const char *name = CACHE_TEXT_NAME;
+  size_t size;
+  char *path;
+
+  if (id != NULL)
+    {
+      if (is_safe_name (id))
+        name = id;
+      else
+        {
+          snprintf (hash, sizeof (hash), "%016" PRIx64,
+                    str_hash (id, strlen (id)));
+          name = hash;
+        }
+    }
+
+  size = entry->dir.size + DIR_SEPARATOR_LEN + strlen (name) + 1 + ext_len;
+  path = malloc (size);
+  if (unlikely (path == NULL))
+    {
+      perror ("malloc");
+      return NULL;
+    }
+  if (ext_len)
+    snprintf (path, size, "%s%c%s.%.*s", entry->dir.name, DIR_SEPARATOR, name,
+              (int) ext_len, ext);
+  else
+    snprintf (path, size, "%s%c%s", entry->dir.name, DIR_SEPARATOR, name);
+  return path;
+}
+
+bool
+cache_write_file (const char *path, const char *text, size_t len,
+                  file_baseline_t *baseline)
+{
+  int fd = -1;
+
+  /* Keep the identity of the file the editor knows */
+  if (access (path, F_OK) == 0)
+    return file_replace_text (path, text, len, baseline);
+
+  fd = open (path, O_RDWR | O_CREAT | O_EXCL | O_BINARY_FLAG, TMP_FILE_MODE);
+  if (fd == -1)
+    {
+      elog_error ("Failed to create %s: %s\n", path, strerror (errno));
+      return false;
+    }
+  if (write (fd, text, len) != (ssize_t) len)
+    {
+      elog_error ("Failed to write %s: %s\n", path, strerror (errno));
+      close (fd);
+      return false;
+    }
+  if (unlikely (close (fd)))
+    {
+      perror ("close");
+      return false;
+    }
+
+  file_baseline_set (baseline, text, len);
+  return true;
+}
+
+void
+cache_close (cache_entry_t *entry)
+{
+  if (entry->lock_fd != -1)
+    {
+      close (entry->lock_fd);
+      entry->lock_fd = -1;
+    }
+  str_destroy (&entry->dir);
+}
+
+static int
+compare_items (const void *a, const void *b)
+{
+  const cache_item_t *x = a;
+  const cache_item_t *y = b;
+
+  /* Most recently used first */
+  return (x->mtime < y->mtime) - (x->mtime > y->mtime);
+}
+
+/* Adds the entry `name` of `root` to `items` */
+static bool
+add_item (cache_item_t **items, size_t *num_items, size_t *items_size,
+          const char *root, const char *name)
+{
+  cache_item_t *item;
+  char *lock_path = NULL;
+  struct stat st;
+
+  if (*num_items == *items_size)
+    {
+      size_t size = *items_size ? *items_size * 2 : 16;
+      cache_item_t *p = realloc (*items, size * sizeof (*p));
+
+      if (unlikely (p == NULL))
+        return false;
+      *items = p;
+      *items_size = size;
+    }
+
+  item = &(*items)[*num_items];
+  if ((item->path = join_path (root, name)) == NULL)
+    return false;
+
+  /* An entry without a lock file was never used */
+  lock_path = join_path (item->path, CACHE_LOCK_NAME);
+  if (lock_path != NULL && stat (lock_path, &st) == 0)
+    item->mtime = st.st_mtime;
+  else if (stat (item->path, &st) == 0)
+    item->mtime = st.st_mtime;
+  else
+    item->mtime = 0;
+  free (lock_path);
+
+  (*num_items)++;
+  return true;
+}
+
+/* Returns true if `name` is an entry moved away by cache_sweep() */
+static bool
+is_trash_name (const char *name)
+{
+  const size_t len = strlen (name);
+  const size_t suffix_len = sizeof (CACHE_TRASH_SUFFIX) - 1;
+
+  return len > suffix_len
+         && !strcmp (name + len - suffix_len, CACHE_TRASH_SUFFIX);
+}
+
+/* Finishes the removal of an entry moved away by an earlier sweep, which
+   failed or was interrupted. Nothing opens it anymore. */
+static void
+remove_trash (const char *root, const char *name)
+{
+  char *path = join_path (root, name);
+
+  if (path == NULL)
+    return;
+  elog_debug ("%s: removing %s\n", __func__, path);
+  remove_session_dir (path);
+  free (path);
+}
+
+void
+cache_sweep (void)
+{
+  char *root = NULL;
+  cache_item_t *items = NULL;
+  size_t num_items = 0;
+  size_t items_size = 0;
+  const time_t now = time (NULL);
+  size_t i;
+
+  if ((root = get_cache_root ()) == NULL)
+    return;
+
+#ifdef WINDOWS
+  {
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = INVALID_HANDLE_VALUE;
+    char *pattern = join_path (root, "*");
+
+    if (pattern == NULL)
+      goto _ret;
+    find = FindFirstFileA (pattern, &find_data);
+    free (pattern);
+    if (find == INVALID_HANDLE_VALUE)
+      goto _ret;
+
+    do
+      {
+        if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            || find_data.cFileName[0] == '.')
+          continue;
+        if (is_trash_name (find_data.cFileName))
+          remove_trash (root, find_data.cFileName);
+        else if (!add_item (&items, &num_items, &items_size, root,
+                            find_data.cFileName))
+          break;
+      }
+    while (FindNextFileA (find, &find_data));
+    FindClose (find);
+  }
+#else
+  {
+    DIR *dir = opendir (root);
+    struct dirent *entry;
+
+    if (dir == NULL)
+      goto _ret;
+
+    while ((entry = readdir (dir)) != NULL)
+      {
+        if (entry->d_name[0] == '.')
+          continue;
+        if (is_trash_name (entry->d_name))
+          remove_trash (root, entry->d_name);
+        else if (!add_item (&items, &num_items, &items_size, root,
+                            entry->d_name))
+          break;
+      }
+    closedir (dir);
+  }
+#endif
+
+  qsort (items, num_items, sizeof (*items), compare_items);
+
+  for (i = 0; i < num_items; i++)
+    {
+      char *trash;
+      int fd;
+
+      if (i < CACHE_MAX_ENTRIES && now - items[i].mtime <= CACHE_MAX_AGE_SEC)
+        continue;
+
+      /* Skip the entries used by running sessions */
+      if ((fd = lock_entry (items[i].path)) == -1)
+        continue;
+
+      /* Move the entry away before removing it. Otherwise, a session
+         opening it meanwhile would create a new lock file in the directory
+         being removed, and lose its files. Such a session now either
+         creates a new entry, or finds its lock file gone (see
+         is_lock_current()). */
+      if ((trash = malloc (strlen (items[i].path)
+                           + sizeof (CACHE_TRASH_SUFFIX))) == NULL)
+        {
+          perror ("malloc");
+          close (fd);
+          break;
+        }
+      sprintf (trash, "%s%s", items[i].path, CACHE_TRASH_SUFFIX);
+#ifdef WINDOWS
+      /* An open file keeps the directory from being moved, so a session
+         which opens the lock file now makes the rename fail */
+      close (fd);
+      fd = -1;
+#endif
+      if (rename (items[i].path, trash) == 0)
+        {
+          elog_debug ("%s: removing %s\n", __func__, items[i].path);
+          remove_session_dir (trash);
+        }
+      else
+        elog_debug ("%s: failed to move %s: %s\n", __func__, items[i].path,
+                    strerror (errno));
+      if (fd != -1)
+        close (fd);
+      free (trash);
+    }
+
+_ret:
+  for (i = 0; i < num_items; i++)
+    free (items[i].path);
+  if (items != NULL) free (items);
+  free (root);
+}
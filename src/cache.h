@@ -0,0 +1,83 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Stable file paths for edits of the same field header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_CACHE_H__
+#define __BEECTL_CACHE_H__
+
+#include "io.h"  /* file_baseline_t */
+#include "str.h" /* str_t */
+
+#include <stdbool.h>
+#include <stddef.h> /* size_t */
+
+/* A request with a "cache_key" gets a directory of its own under the user
+   directory (see get_user_dir()), named after the hash of the key. The
+   files in it keep their paths and identity across sessions, so that
+   editors can reuse their per-file state: undo files, marks, language server
+   indexes and the like. */
+
+/* Directory of the entries in the user directory */
+#define CACHE_DIR_NAME "files"
+
+/* Entries not used for longer are removed by cache_sweep() */
+#define CACHE_MAX_AGE_SEC (7 * 24 * 60 * 60)
+
+/* The least recently used entries above this number are removed by
+   cache_sweep() */
+#define CACHE_MAX_ENTRIES 64
+
+typedef struct _cache_entry_t {
+  /* Directory of the entry */
+  str_t dir;
+  /* Lock held while a session uses the entry, or -1 */
+  int lock_fd;
+} cache_entry_t;
+
+/* Opens the entry for `key`, creating its directory if needed, and locks it
+   for the session. Returns false if the entry can't be used, e.g. because
+   another session holds it; the session should then use a directory of its
+   own. */
+bool cache_open (cache_entry_t *entry, const char *key);
+
+/* Returns the path of the file of a field in the entry. `id` is the field
+   ID, or NULL for the text of a "text" request; `ext` may be NULL. The path
+   must be freed by the caller. */
+char *cache_file_path (const cache_entry_t *entry, const char *id,
+                       const char *ext, size_t ext_len);
+
+/* Sets the content of the file at `path` to `len` bytes of `text`. An
+   existing file is updated in place, and left untouched if the content is
+   the same. `baseline` is set to the content. */
+bool cache_write_file (const char *path, const char *text, size_t len,
+                       file_baseline_t *baseline);
+
+/* Releases the entry. The files are kept for the next session. */
+void cache_close (cache_entry_t *entry);
+
+/* Removes the entries which are too old or above CACHE_MAX_ENTRIES, least
+   recently used first. Entries locked by running sessions are kept. */
+void cache_sweep (void);
+
+#endif /* __BEECTL_CACHE_H__ */
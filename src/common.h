@@ -77,6 +77,7 @@
 # define PATH_DELIMITER ";"
 # define DIR_SEPARATOR '\\'
 # define access _access
+# define strtok_r strtok_s
 # define read _read
 # define unlink _unlink
 # define setmode _setmode
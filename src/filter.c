@@ -0,0 +1,313 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Pipe filter.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "filter.h"
+#include "common.h"
+#include "io.h"
+
+#include <stdlib.h> /* malloc, realloc, free */
+#include <string.h>
+#include <inttypes.h>
+#include <signal.h>
+
+/* Initial room for the output in addition to the size of the input, which
+   is what most filters produce */
+#define FILTER_OUTPUT_RESERVE (64 * 1024)
+
+typedef struct _filter_t {
+  uv_process_t process;
+  uv_pipe_t in;
+  uv_pipe_t out;
+  uv_timer_t timer;
+  uv_write_t write_req;
+  size_t max_output;
+  char *output;
+  size_t output_len;
+  size_t output_size;
+  int64_t exit_status;
+  int term_signal;
+  bool exited;
+  bool timed_out;
+  bool overflow;
+  bool read_failed;
+} filter_t;
+
+static void
+close_handle (uv_handle_t *handle)
+{
+  if (!uv_is_closing (handle))
+    uv_close (handle, NULL);
+}
+
+/* Releases the remaining handles once the command has exited and its output
+   has been read */
+static void
+filter_maybe_finish (filter_t *f)
+{
+  if (!f->exited || !uv_is_closing ((uv_handle_t *) &f->out))
+    return;
+
+  close_handle ((uv_handle_t *) &f->timer);
+  close_handle ((uv_handle_t *) &f->in);
+}
+
+static void
+filter_kill (filter_t *f)
+{
+  int res;
+
+  if (f->exited)
+    return;
+
+  res = uv_process_kill (&f->process, SIGKILL);
+  if (res < 0)
+    elog_error ("Failed to kill filter process: %s\n", uv_strerror (res));
+}
+
+static void
+on_filter_exit (uv_process_t *process, int64_t exit_status, int term_signal)
+{
+  filter_t *f = process->data;
+
+  elog_debug ("%s: filter exited with status %" PRId64 ", signal %d\n",
+              __func__, exit_status, term_signal);
+  f->exit_status = exit_status;
+  f->term_signal = term_signal;
+  f->exited = true;
+  close_handle ((uv_handle_t *) process);
+  filter_maybe_finish (f);
+}
+
+static void
+on_filter_timeout (uv_timer_t *timer)
+{
+  filter_t *f = timer->data;
+
+  f->timed_out = true;
+  filter_kill (f);
+  /* Don't wait for the processes which inherited the output pipe */
+  close_handle ((uv_handle_t *) &f->out);
+  filter_maybe_finish (f);
+}
+
+static void
+on_filter_input_written (uv_write_t *req, int status)
+{
+  filter_t *f = req->data;
+
+  /* The command may exit without reading the whole input (EPIPE) */
+  if (status < 0)
+    elog_debug ("%s: writing filter input failed: %s\n", __func__,
+                uv_strerror (status));
+
+  /* EOF for the command */
+  close_handle ((uv_handle_t *) &f->in);
+}
+
+static void
+on_filter_alloc (uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+  filter_t *f = handle->data;
+  size_t need = f->output_len + suggested_size + 1;
+
+  if (need > f->output_size)
+    {
+      size_t size = f->output_size * 2;
+      char *output;
+
+      if (size < need)
+        size = need;
+      output = realloc (f->output, size);
+      if (unlikely (output == NULL))
+        {
+          /* Reported as UV_ENOBUFS */
+          buf->base = NULL;
+          buf->len = 0;
+          return;
+        }
+      f->output = output;
+      f->output_size = size;
+    }
+
+  /* Reserve a byte for the terminating null */
+  buf->base = f->output + f->output_len;
+  buf->len = f->output_size - f->output_len - 1;
+}
+
+static void
+on_filter_read (uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+  filter_t *f = stream->data;
+
+  if (nread == 0)
+    return;
+
+  if (nread > 0)
+    {
+      f->output_len += (size_t) nread;
+      if (f->output_len <= f->max_output)
+        return;
+
+      elog_error ("Filter output exceeds %zu bytes\n", f->max_output);
+      f->overflow = true;
+      filter_kill (f);
+    }
+  else if (nread != UV_EOF)
+    {
+      elog_error ("Failed to read filter output: %s\n", uv_strerror (nread));
+      f->read_failed = true;
+      filter_kill (f);
+    }
+
+  close_handle ((uv_handle_t *) stream);
+  filter_maybe_finish (f);
+}
+
+filter_status_t
+filter_run (uv_loop_t *loop, char **args,
+            const char *input, size_t input_len,
+            const filter_options_t *options,
+            char **output, size_t *output_len)
+{
+  filter_t f = { 0 };
+  uv_process_options_t proc_options = { 0 };
+  uv_stdio_container_t stdio[3];
+  uv_buf_t buf;
+  uint64_t timeout_ms = options->timeout_ms;
+  filter_status_t status = FILTER_FAILED;
+  int res;
+
+#ifndef WINDOWS
+  /* The command may close its input early. Let the write fail with EPIPE
+     rather than terminate the host. */
+  signal (SIGPIPE, SIG_IGN);
+#endif
+
+  f.max_output = options->max_output;
+  f.output_size = input_len + FILTER_OUTPUT_RESERVE;
+  if (f.output_size > f.max_output + 1)
+    f.output_size = f.max_output + 1;
+  f.output = malloc (f.output_size);
+  if (unlikely (f.output == NULL))
+    {
+      perror ("malloc");
+      return FILTER_FAILED;
+    }
+
+  f.process.data = &f;
+  f.in.data = &f;
+  f.out.data = &f;
+  f.timer.data = &f;
+  f.write_req.data = &f;
+  uv_pipe_init (loop, &f.in, 0);
+  uv_pipe_init (loop, &f.out, 0);
+  uv_timer_init (loop, &f.timer);
+
+  stdio[0].flags = UV_CREATE_PIPE | UV_READABLE_PIPE;
+  stdio[0].data.stream = (uv_stream_t *) &f.in;
+  stdio[1].flags = UV_CREATE_PIPE | UV_WRITABLE_PIPE;
+  stdio[1].data.stream = (uv_stream_t *) &f.out;
+  /* Diagnostics of the command end up in the browser's log */
+  stdio[2].flags = UV_INHERIT_FD;
+  stdio[2].data.fd = STDERR_FILENO;
+
+  proc_options.args = args;
+  proc_options.file = args[0];
+  proc_options.exit_cb = on_filter_exit;
+  proc_options.flags = UV_PROCESS_WINDOWS_HIDE_CONSOLE;
+  proc_options.stdio = stdio;
+  proc_options.stdio_count = 3;
+
+  elog_debug ("%s: spawning filter %s\n", __func__, args[0]);
+  res = uv_spawn (loop, &f.process, &proc_options);
+  if (res < 0)
+    {
+      elog_error ("Failed to spawn filter process: %s\n", uv_strerror (res));
+      f.exited = true;
+      uv_close ((uv_handle_t *) &f.process, NULL);
+      close_handle ((uv_handle_t *) &f.out);
+      filter_maybe_finish (&f);
+      uv_run (loop, UV_RUN_DEFAULT);
+      goto _ret;
+    }
+
+  if (input_len)
+    {
+      buf = uv_buf_init ((char *) input, (unsigned) input_len);
+      res = uv_write (&f.write_req, (uv_stream_t *) &f.in, &buf, 1,
+                      on_filter_input_written);
+      if (res < 0)
+        {
+          elog_error ("Failed to write filter input: %s\n", uv_strerror (res));
+          close_handle ((uv_handle_t *) &f.in);
+        }
+    }
+  else
+    close_handle ((uv_handle_t *) &f.in);
+
+  res = uv_read_start ((uv_stream_t *) &f.out, on_filter_alloc, on_filter_read);
+  if (res < 0)
+    {
+      elog_error ("Failed to read filter output: %s\n", uv_strerror (res));
+      f.read_failed = true;
+      filter_kill (&f);
+      close_handle ((uv_handle_t *) &f.out);
+    }
+
+  /* A command must not hold the host forever */
+  if (timeout_ms == 0 || timeout_ms > FILTER_MAX_TIMEOUT_MS)
+    timeout_ms = FILTER_MAX_TIMEOUT_MS;
+  uv_timer_start (&f.timer, on_filter_timeout, timeout_ms, 0);
+
+  uv_run (loop, UV_RUN_DEFAULT);
+
+  if (f.overflow)
+    status = FILTER_OUTPUT_OVERFLOW; /* Already reported */
+  else if (f.read_failed)
+    ; /* Already reported */
+  else if (f.timed_out)
+    {
+      elog_error ("Filter timed out after %" PRIu64 " ms\n", timeout_ms);
+      status = FILTER_TIMED_OUT;
+    }
+  else if (f.term_signal)
+    elog_error ("Filter was terminated by signal %d\n", f.term_signal);
+  else if (f.exit_status != 0)
+    elog_error ("Filter exited with status %" PRId64 "\n", f.exit_status);
+  else
+    status = FILTER_OK;
+
+_ret:
+  if (status == FILTER_OK)
+    {
+      f.output[f.output_len] = '\0';
+      *output = f.output;
+      *output_len = f.output_len;
+    }
+  else
+    free (f.output);
+
+  return status;
+}
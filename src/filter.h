@@ -0,0 +1,85 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Pipe filter header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_FILTER_H__
+#define __BEECTL_FILTER_H__
+
+#include <stdbool.h>
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint64_t */
+
+#include <uv.h>
+
+/* Time a filter command may run, unless the request specifies "timeout" */
+#define FILTER_DEFAULT_TIMEOUT_MS 10000
+
+/* Longest time a filter command may run. Longer timeouts, and 0, are
+   clamped to it. */
+#define FILTER_MAX_TIMEOUT_MS (5 * 60 * 1000)
+
+/* Maximum size of the output of a filter command, unless the request
+   specifies "max_output" */
+#define FILTER_DEFAULT_MAX_OUTPUT (64 * 1024 * 1024)
+
+/* Codes of the error responses for the failed filter commands */
+#define FILTER_ERROR_TIMEOUT "filter_timeout"
+#define FILTER_ERROR_OUTPUT_TOO_LARGE "filter_output_too_large"
+#define FILTER_ERROR_FAILED "filter_failed"
+
+typedef enum _filter_status_t {
+  FILTER_OK = 0,
+  /* Killed after the timeout */
+  FILTER_TIMED_OUT,
+  /* Killed after writing more than the maximum output */
+  FILTER_OUTPUT_OVERFLOW,
+  /* Not started, terminated by a signal, non-zero exit status, or I/O
+     error */
+  FILTER_FAILED,
+} filter_status_t;
+
+typedef struct _filter_options_t {
+  /* The command is killed if it doesn't finish in time (see
+     FILTER_MAX_TIMEOUT_MS) */
+  uint64_t timeout_ms;
+  /* The command is killed if it writes more bytes */
+  size_t max_output;
+} filter_options_t;
+
+/* Runs a non-interactive command over a text.
+
+   `args` is the NULL-terminated command line; args[0] is the executable.
+   The `input_len` bytes of `input` are written to the standard input of the
+   command, and its standard output is collected while the command runs.
+
+   Returns FILTER_OK if the command exited with status 0 within the limits
+   of `options`. The output is then saved into `output` as a null-terminated
+   string, and its length into `output_len`. The output must be freed by the
+   caller. */
+filter_status_t filter_run (uv_loop_t *loop, char **args,
+                            const char *input, size_t input_len,
+                            const filter_options_t *options,
+                            char **output, size_t *output_len);
+
+#endif /* __BEECTL_FILTER_H__ */
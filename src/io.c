@@ -24,8 +24,15 @@
  */
 #include "io.h"
 #include "common.h"
+#include "json.h"
+#include "utf8.h"
+#ifdef HAVE_IO_URING
+# include "uring.h"
+#endif
 #include "mkstemps.h"
 #include "str.h"
+#include "probes.h"
+#include "admission.h"
 
 #include <assert.h>
 #include <errno.h>
@@ -37,17 +44,55 @@
 #include <sys/types.h>
 
 #ifdef WINDOWS
+#include <direct.h>  /* _mkdir */
 #include <io.h>      /* _access, read, _mktemp_s, _open */
 #include <process.h> /* _execl */
+#include <share.h>   /* _SH_DENYRW */
 #include <wchar.h>
+#else
+#include <dirent.h>   /* opendir readdir closedir */
+#include <sys/file.h> /* flock */
+#include <sys/uio.h> /* writev */
 #endif
 
-#include "cjson/cJSON.h"
-
 static FILE *elog_fp = NULL;
 
+/* Encoding of the edited file if it isn't valid UTF-8 */
+static utf8_fallback_t response_fallback = UTF8_FALLBACK_REPLACE;
+
+/* Whether the growth of a file may be sent as {"append":"..."} */
+static bool response_append = false;
+
+/* Number of snapshots found torn by a concurrent write */
+static uint64_t num_torn_reads = 0;
+
+/* Identity, size and modification time of a file */
+typedef struct _file_stamp_t {
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  time_t mtime_sec;
+  long mtime_nsec;
+} file_stamp_t;
+
 #define TMP_FILENAME_TEMPLATE "chrome_bee_XXXXXXXX"
 
+/* Session directories are created in the user directory (see
+   get_user_dir()) from SESSION_DIR_TEMPLATE. Next to each, there is a lock
+   file with SESSION_LOCK_SUFFIX appended to the name, which is locked while
+   the session runs. */
+#define SESSION_DIR_PREFIX "session_"
+#define SESSION_DIR_TEMPLATE SESSION_DIR_PREFIX "XXXXXX"
+#define SESSION_LOCK_SUFFIX ".lock"
+
+/* Maximum number of session directories of a process */
+#define MAX_SESSION_LOCKS 4
+
+typedef struct _session_lock_t {
+  char *dir;
+  int fd;
+} session_lock_t;
+
 #ifndef NDEBUG
 void
 elog_close (void)
@@ -230,10 +275,19 @@ safe_read (int fd, void *buf, size_t count)
   return n;
 }
 
+/* Initial size of the buffer of a request. The buffer grows as the bytes
+   arrive, so that a bogus length doesn't allocate memory up front. */
+#define REQUEST_INITIAL_BUF_SIZE (64 * 1024)
+
 char *
 read_browser_request (uint32_t *size)
 {
+  const uint32_t max_frame = admission_limits ()->max_frame;
   char *text = NULL;
+  size_t cap = 0;
+  size_t len = 0;
+
+  BEECTL_PROBE0 (request_start);
 
   /* First 4 bytes is the message type */
   if (safe_read (STDIN_FILENO, size, 4) != 4)
@@ -242,35 +296,154 @@ read_browser_request (uint32_t *size)
       return text;
     }
 
-  if (unlikely ((text = malloc (*size)) == NULL))
+  if (max_frame && *size > max_frame)
     {
-      perror ("Failed to allocate memory for the text");
-      return text;
+      elog_error ("Request of %u bytes exceeds the limit of %u bytes\n",
+                  *size, max_frame);
+      send_error_response (ADMISSION_FRAME_TOO_LARGE,
+                           "The request exceeds " ADMISSION_MAX_FRAME_ENV);
+      return NULL;
     }
 
-  if (safe_read (STDIN_FILENO, text, *size) != *size)
+  do
     {
-      elog_error ("Failed to read request body\n");
-      free (text);
-      return NULL;
+      char *p;
+
+      cap = cap == 0 ? REQUEST_INITIAL_BUF_SIZE : cap * 2;
+      if (cap > *size)
+        cap = *size;
+      if (unlikely ((p = realloc (text, cap ? cap : 1)) == NULL))
+        {
+          perror ("Failed to allocate memory for the text");
+          free (text);
+          return NULL;
+        }
+      text = p;
+
+      if (safe_read (STDIN_FILENO, text + len, cap - len) != (ssize_t) (cap - len))
+        {
+          elog_error ("Failed to read request body\n");
+          free (text);
+          return NULL;
+        }
+      len = cap;
     }
+  while (len < *size);
 
+  BEECTL_PROBE1 (request_done, *size);
   return text;
 }
 
+char *
+frame_reader_reserve (frame_reader_t *reader, size_t hint, size_t *avail)
+{
+  size_t need = reader->len + hint;
+
+  if (need > reader->size)
+    {
+      /* The buffer grows as the bytes of a large frame arrive */
+      size_t size = reader->size * 2 > need ? reader->size * 2 : need;
+      char *buf;
+
+      if (reader->len >= sizeof (uint32_t) && reader->skip == 0)
+        {
+          uint32_t body_len;
+          memcpy (&body_len, reader->buf, sizeof (body_len));
+          if (size > sizeof (uint32_t) + (size_t) body_len
+              && need <= sizeof (uint32_t) + (size_t) body_len)
+            size = sizeof (uint32_t) + (size_t) body_len;
+        }
+
+      buf = realloc (reader->buf, size);
+      if (unlikely (buf == NULL))
+        {
+          elog_error ("Failed to allocate %zu bytes for a frame\n", size);
+          return NULL;
+        }
+      reader->buf = buf;
+      reader->size = size;
+    }
+
+  *avail = reader->size - reader->len;
+  return reader->buf + reader->len;
+}
+
+unsigned
+frame_reader_consume (frame_reader_t *reader, size_t n,
+                      frame_cb_t cb, void *arg)
+{
+  const uint32_t max_frame = admission_limits ()->max_frame;
+  size_t pos = 0;
+  unsigned num_dropped = 0;
+
+  reader->len += n;
+
+  for (;;)
+    {
+      uint32_t body_len;
+
+      /* The rest of a dropped frame */
+      if (reader->skip)
+        {
+          size_t skipped = reader->len - pos < reader->skip
+                           ? reader->len - pos : reader->skip;
+
+          pos += skipped;
+          reader->skip -= skipped;
+          if (reader->skip)
+            break;
+        }
+
+      if (reader->len - pos < sizeof (uint32_t))
+        break;
+
+      memcpy (&body_len, reader->buf + pos, sizeof (body_len));
+      if (max_frame && body_len > max_frame)
+        {
+          elog_error ("Dropping a frame of %u bytes exceeding the limit of "
+                      "%u bytes\n", body_len, max_frame);
+          num_dropped++;
+          pos += sizeof (uint32_t);
+          reader->skip = body_len;
+          continue;
+        }
+      if (reader->len - pos - sizeof (uint32_t) < body_len)
+        break;
+
+      cb (reader->buf + pos + sizeof (uint32_t), body_len, arg);
+      pos += sizeof (uint32_t) + body_len;
+    }
+
+  /* Keep the incomplete frame */
+  if (pos)
+    {
+      memmove (reader->buf, reader->buf + pos, reader->len - pos);
+      reader->len -= pos;
+    }
+
+  return num_dropped;
+}
+
+void
+frame_reader_destroy (frame_reader_t *reader)
+{
+  free (reader->buf);
+  memset (reader, 0, sizeof (*reader));
+}
+
 
 char *
 read_file_from_fd (int fd, size_t *len)
 {
-  size_t bytes_read;
   char *text = NULL;
-  *len = lseek (fd, 0, SEEK_END);
+  struct stat st;
 
-  if (unlikely (*len == -1))
+  if (unlikely (fstat (fd, &st) == -1))
     {
-      perror ("lseek");
+      perror ("fstat");
       return NULL;
     }
+  *len = st.st_size;
 
   if (unlikely (lseek (fd, 0, SEEK_SET) == -1))
     {
@@ -286,7 +459,6 @@ read_file_from_fd (int fd, size_t *len)
                   strerror (errno));
       return NULL;
     }
-  memset (text, 0, *len + 1);
 
   if (safe_read (fd, text, *len) != *len)
     {
@@ -439,6 +611,73 @@ get_sys_temp_dir (str_t *sys_temp_dir)
 }
 
 
+bool
+get_user_dir (str_t *dir)
+{
+  str_t sys_temp_dir = { 0 };
+  char *path = NULL;
+  size_t path_size = 0;
+  bool ok = false;
+#ifndef WINDOWS
+  const char *runtime_dir = getenv ("XDG_RUNTIME_DIR");
+  struct stat st;
+
+  if (runtime_dir != NULL && *runtime_dir)
+    {
+      path_size = strlen (runtime_dir) + sizeof ("/beectl");
+      if ((path = malloc (path_size)) != NULL)
+        snprintf (path, path_size, "%s/beectl", runtime_dir);
+    }
+  else if (get_sys_temp_dir (&sys_temp_dir) != NULL
+           && sys_temp_dir.name != NULL)
+    {
+      /* Room for '/', "beectl-", up to 20 uid digits and the 0 byte */
+      path_size = sys_temp_dir.size + sizeof ("/beectl-") + 20;
+      if ((path = malloc (path_size)) != NULL)
+        snprintf (path, path_size, "%s/beectl-%ld", sys_temp_dir.name,
+                  (long) getuid ());
+    }
+  if (path == NULL)
+    goto _ret;
+
+  if (mkdir (path, 0700) == -1 && errno != EEXIST)
+    {
+      elog_error ("Failed to create %s: %s\n", path, strerror (errno));
+      goto _ret;
+    }
+  /* Don't use a directory which someone else could have prepared */
+  if (lstat (path, &st) == -1 || !S_ISDIR (st.st_mode)
+      || st.st_uid != getuid () || (st.st_mode & 077))
+    {
+      elog_error ("%s is not a private directory\n", path);
+      goto _ret;
+    }
+#else
+  if (get_sys_temp_dir (&sys_temp_dir) == NULL || sys_temp_dir.name == NULL)
+    goto _ret;
+  path_size = sys_temp_dir.size + sizeof ("\\beectl");
+  if ((path = malloc (path_size)) == NULL)
+    goto _ret;
+  snprintf (path, path_size, "%s\\beectl", sys_temp_dir.name);
+  if (_mkdir (path) == -1 && errno != EEXIST)
+    {
+      elog_error ("Failed to create %s: %s\n", path, strerror (errno));
+      goto _ret;
+    }
+#endif
+
+  dir->name = path;
+  dir->size = strlen (path) + 1;
+  path = NULL;
+  ok = true;
+
+_ret:
+  if (path != NULL) free (path);
+  str_destroy (&sys_temp_dir);
+  return ok;
+}
+
+
 int
 open_tmp_file (char **out_path, str_t *tmp_dir, const char* ext, unsigned ext_len)
 {
@@ -453,7 +692,7 @@ open_tmp_file (char **out_path, str_t *tmp_dir, const char* ext, unsigned ext_le
       return -1;
     }
 
-  if (unlikely (get_sys_temp_dir (tmp_dir) == NULL))
+  if (tmp_dir->name == NULL && unlikely (get_sys_temp_dir (tmp_dir) == NULL))
     {
       elog_error ("get_sys_temp_dir() failed: %s\n", strerror (errno));
       return -1;
@@ -530,118 +769,1459 @@ _ret:
 }
 
 
-bool
-remove_file (const char* filename)
+/* Lock files of the session directories created by this process. The
+   directories are created and removed by one thread at a time. */
+static session_lock_t session_locks[MAX_SESSION_LOCKS];
+
+/* Opens and locks an existing lock file without waiting. Returns the
+   descriptor, or -1 if the file is locked by another process (or can't be
+   opened). */
+static int
+lock_session_file (const char *path)
 {
-  assert (filename);
-  if (unlikely (filename == NULL))
-    return false;
+  int fd = -1;
 
-  if (unlikely (unlink (filename)))
+#ifdef WINDOWS
+  /* The file can't be opened again while the exclusive share mode is in
+     effect */
+  if (_sopen_s (&fd, path, _O_RDWR | _O_BINARY, _SH_DENYRW,
+                _S_IREAD | _S_IWRITE) != 0)
+    fd = -1;
+#else
+  struct stat fd_st;
+  struct stat path_st;
+
+  fd = open (path, O_RDWR | O_CLOEXEC);
+  if (fd == -1)
+    return -1;
+  /* The file may have been removed by a sweep between the open and the
+     lock */
+  if (flock (fd, LOCK_EX | LOCK_NB) == -1
+      || fstat (fd, &fd_st) == -1 || stat (path, &path_st) == -1
+      || fd_st.st_dev != path_st.st_dev || fd_st.st_ino != path_st.st_ino)
     {
-      perror ("unlink");
-      return false;
+      close (fd);
+      fd = -1;
     }
+#endif
 
-  return true;
+  return fd;
 }
 
-char *
-make_response (int fd, uint32_t *size)
+
+bool
+create_session_dir (str_t *session_dir)
 {
-  size_t text_len = 0;
-  char *text = NULL;
-  char *response = NULL;
-  const char *error = NULL;
-  cJSON *json_response = NULL;
-  cJSON *json_text = NULL;
+  str_t user_dir = { 0 };
+  size_t path_size = 0;
+  char *path = NULL;
+  session_lock_t *lock = NULL;
+  int fd = -1;
+  bool ok = false;
 
-  text = read_file_from_fd (fd, &text_len);
-  if (unlikely (text == NULL))
-    goto _ret;
+  for (unsigned i = 0; i < MAX_SESSION_LOCKS && lock == NULL; i++)
+    {
+      if (session_locks[i].dir == NULL)
+        lock = &session_locks[i];
+    }
+  if (unlikely (lock == NULL))
+    {
+      elog_error ("Too many session directories\n");
+      return false;
+    }
 
-  json_text = cJSON_CreateStringReference (text);
-  if (unlikely (json_text == NULL))
-    goto _ret;
+  if (!get_user_dir (&user_dir))
+    return false;
 
-  json_response = cJSON_CreateObject();
-  if (unlikely (json_response == NULL))
+  path_size = (user_dir.size - 1) + DIR_SEPARATOR_LEN
+    + sizeof (SESSION_DIR_TEMPLATE SESSION_LOCK_SUFFIX);
+  path = malloc (path_size);
+  if (unlikely (path == NULL))
     {
-      cJSON_Delete (json_text);
-      json_text = NULL;
+      elog_error ("malloc failed: %s\n", strerror (errno));
       goto _ret;
     }
 
-  if (unlikely (!cJSON_AddItemReferenceToObject (json_response, "text", json_text)))
+  /* The lock file is created first, so that the directory is never left
+     without one */
+  for (int i = 0; i < 100 && !ok; i++)
     {
-      error = cJSON_GetErrorPtr ();
-      if (error != NULL)
-        elog_error ("Failed adding 'text' to JSON response: %s\n", error);
-      cJSON_Delete (json_text);
-      json_text = NULL;
-      goto _ret;
+      snprintf (path, path_size, "%s%c" SESSION_DIR_TEMPLATE SESSION_LOCK_SUFFIX,
+                user_dir.name, DIR_SEPARATOR);
+      fd = mkstemps (path, sizeof (SESSION_LOCK_SUFFIX) - 1);
+      if (fd == -1)
+        {
+          elog_error ("mkstemps: Failed to create lock file %s: %s\n", path,
+                      strerror (errno));
+          break;
+        }
+      close (fd);
+
+      fd = lock_session_file (path);
+      path[strlen (path) - (sizeof (SESSION_LOCK_SUFFIX) - 1)] = '\0';
+      if (fd != -1)
+        {
+#ifdef WINDOWS
+          if (_mkdir (path) == 0)
+#else
+          if (mkdir (path, 0700) == 0)
+#endif
+            ok = true;
+          else if (errno != EEXIST)
+            {
+              elog_error ("Failed to create session directory %s: %s\n",
+                          path, strerror (errno));
+              break;
+            }
+        }
+      /* Swept before it was locked, or the name of a directory left by an
+         interrupted sweep */
+      if (!ok)
+        {
+          if (fd != -1)
+            close (fd);
+          fd = -1;
+          strcat (path, SESSION_LOCK_SUFFIX);
+          unlink (path);
+        }
     }
-  /* From this point, json_text is owned by json_response */
 
-  response = cJSON_PrintUnformatted (json_response);
-  if (unlikely (response == NULL))
+  if (ok)
     {
-      if ((error = cJSON_GetErrorPtr ()) != NULL)
-        elog_error ("Failed converting JSON to string: %s\n", error);
-      goto _ret;
+      elog_debug ("%s: created %s\n", __func__, path);
+      lock->dir = strdup (path);
+      lock->fd = fd;
+      fd = -1;
+      session_dir->name = path;
+      session_dir->size = strlen (path) + 1;
+      path = NULL;
     }
 
-  *size = strlen (response) + 1;
-
 _ret:
-  if (text != NULL) free (text);
-  if (json_response != NULL) cJSON_Delete (json_response);
-  if (json_text != NULL) cJSON_Delete (json_text);
+  if (fd != -1)
+    close (fd);
+  if (path != NULL)
+    free (path);
+  str_destroy (&user_dir);
+  return ok;
+}
 
-  return response;
+
+/* Removes a directory along with everything in it. Symbolic links are
+   removed, not followed. */
+static bool
+remove_tree (const char *path)
+{
+  size_t path_len = strlen (path);
+  char *entry_path = NULL;
+  size_t entry_path_size = 0;
+  bool ok = true;
+
+#ifdef WINDOWS
+  {
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = INVALID_HANDLE_VALUE;
+    char *pattern = malloc (path_len + sizeof ("\\*"));
+
+    if (unlikely (pattern == NULL))
+      return false;
+    snprintf (pattern, path_len + sizeof ("\\*"), "%s\\*", path);
+    find = FindFirstFileA (pattern, &find_data);
+    free (pattern);
+
+    if (find != INVALID_HANDLE_VALUE)
+      {
+        do
+          {
+            const char *name = find_data.cFileName;
+            const DWORD attrs = find_data.dwFileAttributes;
+            size_t size = path_len + DIR_SEPARATOR_LEN + strlen (name) + 1;
+
+            if (!strcmp (name, ".") || !strcmp (name, ".."))
+              continue;
+            if (size > entry_path_size)
+              {
+                char *p = realloc (entry_path, size);
+                if (unlikely (p == NULL))
+                  {
+                    ok = false;
+                    break;
+                  }
+                entry_path = p;
+                entry_path_size = size;
+              }
+            snprintf (entry_path, size, "%s%c%s", path, DIR_SEPARATOR, name);
+            if (!(attrs & FILE_ATTRIBUTE_DIRECTORY))
+              {
+                if (!DeleteFileA (entry_path))
+                  {
+                    elog_error ("Failed to remove %s\n", entry_path);
+                    ok = false;
+                  }
+              }
+            else if (attrs & FILE_ATTRIBUTE_REPARSE_POINT)
+              {
+                if (!RemoveDirectoryA (entry_path))
+                  {
+                    elog_error ("Failed to remove %s\n", entry_path);
+                    ok = false;
+                  }
+              }
+            else if (!remove_tree (entry_path))
+              ok = false;
+          }
+        while (FindNextFileA (find, &find_data));
+        FindClose (find);
+      }
+
+    if (!RemoveDirectoryA (path))
+      {
+        elog_error ("Failed to remove directory %s\n", path);
+        ok = false;
+      }
+  }
+#else
+  {
+    DIR *dir = opendir (path);
+    struct dirent *entry;
+    struct stat st;
+
+    if (dir == NULL)
+      {
+        if (errno == ENOENT)
+          return true;
+        elog_error ("opendir(%s) failed: %s\n", path, strerror (errno));
+        return false;
+      }
+
+    while ((entry = readdir (dir)) != NULL)
+      {
+        const char *name = entry->d_name;
+        size_t size = path_len + DIR_SEPARATOR_LEN + strlen (name) + 1;
+
+        if (!strcmp (name, ".") || !strcmp (name, ".."))
+          continue;
+        if (size > entry_path_size)
+          {
+            char *p = realloc (entry_path, size);
+            if (unlikely (p == NULL))
+              {
+                ok = false;
+                break;
+              }
+            entry_path = p;
+            entry_path_size = size;
+          }
+        snprintf (entry_path, size, "%s%c%s", path, DIR_SEPARATOR, name);
+        if (lstat (entry_path, &st) == 0 && S_ISDIR (st.st_mode))
+          {
+            if (!remove_tree (entry_path))
+              ok = false;
+          }
+        else if (unlink (entry_path) && errno != ENOENT)
+          {
+            elog_error ("Failed to remove %s: %s\n", entry_path,
+                        strerror (errno));
+            ok = false;
+          }
+      }
+    closedir (dir);
+
+    if (rmdir (path) && errno != ENOENT)
+      {
+        elog_error ("Failed to remove directory %s: %s\n", path,
+                    strerror (errno));
+        ok = false;
+      }
+  }
+#endif
+
+  if (entry_path != NULL)
+    free (entry_path);
+  return ok;
 }
 
-void
-send_file_response (const char *filepath)
+
+/* Removes the lock file of the directory at `path` and releases its lock,
+   which is held by `fd` */
+static void
+remove_session_lock (const char *path, int fd)
 {
-  int fd = -1;
-  char *response = NULL;
-  uint32_t json_size = 0;
+  size_t size = strlen (path) + sizeof (SESSION_LOCK_SUFFIX);
+  char *lock_path = malloc (size);
 
-  /* We need to open file in binary mode in Windows because otherwise the C
-   * runtime may transform the data as it is read. */
-  fd = open (filepath, O_RDONLY | O_BINARY_FLAG);
-  if (fd == -1)
+  if (lock_path != NULL)
     {
-      elog_error ("%s: Failed to open file %s: %s\n", __func__, filepath,
-                  strerror (errno));
-      goto _ret;
+      snprintf (lock_path, size, "%s" SESSION_LOCK_SUFFIX, path);
+#ifdef WINDOWS
+      /* A file can't be removed while it's open */
+      close (fd);
+      fd = -1;
+#endif
+      if (unlink (lock_path) && errno != ENOENT)
+        elog_error ("Failed to remove %s: %s\n", lock_path, strerror (errno));
+      free (lock_path);
     }
+  if (fd != -1)
+    close (fd);
+}
 
-  elog_debug ("%s: making response fd=%ld file=%s\n", __func__, fd, filepath);
 
-  response = make_response (fd, &json_size);
-  close(fd);
+bool
+remove_session_dir (const char *path)
+{
+  bool ok = false;
 
-  if (response == NULL)
+  assert (path);
+  if (unlikely (path == NULL))
+    return false;
+
+  /* Remove whatever the editor left behind: swap files, backups,
+     directories etc. */
+  ok = remove_tree (path);
+
+  for (unsigned i = 0; i < MAX_SESSION_LOCKS; i++)
     {
-      elog_debug ("Failed to create response\n");
-      goto _ret;
+      session_lock_t *lock = &session_locks[i];
+
+      if (lock->dir == NULL || strcmp (lock->dir, path))
+        continue;
+      /* If the directory is still there, leave the lock file, so that the
+         sweep of a later session retries the removal */
+      if (ok)
+        remove_session_lock (path, lock->fd);
+      else
+        close (lock->fd);
+      free (lock->dir);
+      lock->dir = NULL;
+      lock->fd = -1;
+      break;
     }
 
-  json_size--; /* exclude trailing \0 */
+  return ok;
+}
 
-  elog_debug ("writing response size\n");
-  if (unlikely (write (STDOUT_FILENO, &json_size, sizeof (uint32_t)) != sizeof (uint32_t)))
+
+/* Returns true if `name` is the name of the lock file of a session
+   directory */
+static bool
+is_session_lock_name (const char *name)
+{
+  return strlen (name) == sizeof (SESSION_DIR_TEMPLATE SESSION_LOCK_SUFFIX) - 1
+         && !strncmp (name, SESSION_DIR_PREFIX, sizeof (SESSION_DIR_PREFIX) - 1)
+         && !strcmp (name + sizeof (SESSION_DIR_TEMPLATE) - 1,
+                     SESSION_LOCK_SUFFIX);
+}
+
+
+/* Removes the session directory of the lock file `name` in `user_dir`
+   unless the session is still running */
+static void
+sweep_session_dir (const char *user_dir, const char *name)
+{
+  size_t size = strlen (user_dir) + DIR_SEPARATOR_LEN + strlen (name) + 1;
+  char *path = NULL;
+  int fd = -1;
+
+  if (!is_session_lock_name (name) || (path = malloc (size)) == NULL)
+    return;
+  snprintf (path, size, "%s%c%s", user_dir, DIR_SEPARATOR, name);
+
+  fd = lock_session_file (path);
+  if (fd != -1)
     {
-      elog_error ("Failed to write response size: %s\n", strerror (errno));
-      goto _ret;
+      path[size - 1 - (sizeof (SESSION_LOCK_SUFFIX) - 1)] = '\0';
+      elog_debug ("%s: removing stale %s\n", __func__, path);
+      if (remove_tree (path))
+        remove_session_lock (path, fd);
+      else
+        close (fd);
     }
 
-  elog_debug ("writing response body (length %u)\n", json_size);
-  if (unlikely (write (STDOUT_FILENO, response, json_size) != json_size))
-    elog_error ("Failed to write response body: %s\n", strerror (errno));
+  free (path);
+}
+
+
+void
+sweep_session_dirs (void)
+{
+  str_t user_dir = { 0 };
+
+  /* Only the directories of the current user are there */
+  if (!get_user_dir (&user_dir))
+    return;
+
+#ifdef WINDOWS
+  {
+    WIN32_FIND_DATAA find_data;
+    HANDLE find = INVALID_HANDLE_VALUE;
+    size_t pattern_size = user_dir.size
+      + sizeof ("\\" SESSION_DIR_PREFIX "*" SESSION_LOCK_SUFFIX);
+    char *pattern = malloc (pattern_size);
+
+    if (unlikely (pattern == NULL))
+      goto _ret;
+    snprintf (pattern, pattern_size,
+              "%s\\" SESSION_DIR_PREFIX "*" SESSION_LOCK_SUFFIX, user_dir.name);
+    find = FindFirstFileA (pattern, &find_data);
+    free (pattern);
+    if (find == INVALID_HANDLE_VALUE)
+      goto _ret;
+
+    do
+      {
+        if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+          sweep_session_dir (user_dir.name, find_data.cFileName);
+      }
+    while (FindNextFileA (find, &find_data));
+    FindClose (find);
+  }
+#else
+  {
+    DIR *dir = opendir (user_dir.name);
+    struct dirent *entry;
+
+    if (dir == NULL)
+      goto _ret;
+
+    /* The lock files of the sessions of this process are locked, and
+       skipped */
+    while ((entry = readdir (dir)) != NULL)
+      sweep_session_dir (user_dir.name, entry->d_name);
+    closedir (dir);
+  }
+#endif
 
 _ret:
-  if (response != NULL) free (response);
+  str_destroy (&user_dir);
+}
+
+
+bool
+add_tmp_file_ext (char **path, const char *ext, unsigned ext_len)
+{
+  size_t path_len = strlen (*path);
+  size_t new_path_size = path_len + 1 + ext_len + 1;
+  char *new_path = NULL;
+
+  new_path = malloc (new_path_size);
+  if (unlikely (new_path == NULL))
+    {
+      elog_error ("malloc failed: %s\n", strerror (errno));
+      return false;
+    }
+  snprintf (new_path, new_path_size, "%s.%.*s", *path, (int)ext_len, ext);
+
+#ifdef WINDOWS
+  /* Windows doesn't allow renaming a file opened without FILE_SHARE_DELETE */
+  free (new_path);
+  return false;
+#else
+  /* Unlike rename(), link() fails if the new path exists */
+  if (link (*path, new_path))
+    {
+      elog_debug ("%s: link(%s, %s) failed: %s\n", __func__, *path, new_path,
+                  strerror (errno));
+      free (new_path);
+      return false;
+    }
+
+  if (unlikely (unlink (*path)))
+    elog_error ("Failed to unlink %s: %s\n", *path, strerror (errno));
+
+  free (*path);
+  *path = new_path;
+  return true;
+#endif
+}
+
+
+void
+prefetch_file (const char *path)
+{
+#ifdef POSIX_FADV_WILLNEED
+  int fd = open (path, O_RDONLY | O_BINARY_FLAG);
+
+  if (fd == -1)
+    return;
+
+  if (posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED))
+    elog_debug ("%s: posix_fadvise failed for %s\n", __func__, path);
+  close (fd);
+#else
+  (void) path;
+#endif
+}
+
+
+bool
+remove_file (const char* filename)
+{
+  assert (filename);
+  if (unlikely (filename == NULL))
+    return false;
+
+  if (unlikely (unlink (filename)))
+    {
+      perror ("unlink");
+      return false;
+    }
+
+  return true;
+}
+
+char *
+make_text_response (const char *text, size_t len, uint32_t *size)
+{
+  return json_make_string_object ("text", text, len, size);
+}
+
+char *
+make_response (int fd, uint32_t *size)
+{
+  size_t text_len = 0;
+  char *text = NULL;
+  char *response = NULL;
+
+  text = read_file_from_fd (fd, &text_len);
+  if (unlikely (text == NULL))
+    return NULL;
+
+  response = make_text_response (text, text_len, size);
+  free (text);
+
+  return response;
+}
+
+/* Records `len` bytes of `text` with the str_hash() `hash` as the content
+   known to the browser */
+static void
+set_baseline (file_baseline_t *baseline, const char *text, size_t len,
+              uint64_t hash)
+{
+  size_t window = len < APPEND_WINDOW ? len : APPEND_WINDOW;
+
+  baseline->size = len;
+  baseline->hash = hash;
+  baseline->valid = true;
+  baseline->shrunk = false;
+
+  baseline->appendable = response_append;
+  if (!response_append)
+    return;
+  baseline->tail_hash = str_hash (text + len - window, window);
+  str_hash_init (&baseline->hash_state);
+  str_hash_update (&baseline->hash_state, text, len);
+}
+
+void
+file_baseline_set (file_baseline_t *baseline, const char *text, size_t len)
+{
+  set_baseline (baseline, text, len, str_hash (text, len));
+}
+
+/* Writes `len` bytes of `buf` at `offset` of the file */
+static bool
+write_at (int fd, const char *buf, size_t len, size_t offset)
+{
+#ifdef WINDOWS
+  if (_lseeki64 (fd, offset, SEEK_SET) == -1)
+    return false;
+#endif
+
+  while (len)
+    {
+#ifdef WINDOWS
+      int n = write (fd, buf, (unsigned) len);
+#else
+      ssize_t n = pwrite (fd, buf, len, (off_t) offset);
+#endif
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      buf += n;
+      len -= (size_t) n;
+      offset += (size_t) n;
+    }
+
+  return true;
+}
+
+/* Reads `len` bytes at `offset` of the file into `buf`. Fails if the file
+   ends before. */
+static bool
+read_at (int fd, char *buf, size_t len, size_t offset)
+{
+#ifdef WINDOWS
+  if (_lseeki64 (fd, offset, SEEK_SET) == -1)
+    return false;
+#endif
+
+  while (len)
+    {
+#ifdef WINDOWS
+      int n = read (fd, buf, (unsigned) len);
+#else
+      ssize_t n = pread (fd, buf, len, (off_t) offset);
+#endif
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      buf += n;
+      len -= (size_t) n;
+      offset += (size_t) n;
+    }
+
+  return true;
+}
+
+/* Replaces `length` bytes at `offset` in the file with `len` bytes of
+   `text`. If `whole` is true, the entire content is replaced. */
+static bool
+replace_file_range (const char *path, bool whole, size_t offset,
+                    size_t length, const char *text, size_t len,
+                    file_baseline_t *baseline)
+{
+  int fd = -1;
+  char *old = NULL;
+  size_t old_len = 0;
+  char *new = NULL;
+  size_t new_len = 0;
+  size_t first = 0;
+  size_t end = 0;
+  bool success = false;
+
+  fd = open (path, O_RDWR | O_BINARY_FLAG);
+  if (fd == -1)
+    {
+      elog_error ("%s: Failed to open file %s: %s\n", __func__, path,
+                  strerror (errno));
+      return false;
+    }
+
+  old = read_file_from_fd (fd, &old_len);
+  if (unlikely (old == NULL))
+    goto _ret;
+
+  if (whole)
+    {
+      offset = 0;
+      length = old_len;
+    }
+  if (offset > old_len || length > old_len - offset)
+    {
+      elog_error ("Range %zu+%zu is out of the file bounds (%zu bytes)\n",
+                  offset, length, old_len);
+      goto _ret;
+    }
+
+  new_len = old_len - length + len;
+  new = malloc (new_len + 1);
+  if (unlikely (new == NULL))
+    {
+      perror ("malloc");
+      goto _ret;
+    }
+  memcpy (new, old, offset);
+  memcpy (new + offset, text, len);
+  memcpy (new + offset + len, old + offset + length, old_len - offset - length);
+
+  /* Write only the bytes that differ. If the length changes, everything
+     after the first difference shifts. */
+  while (first < old_len && first < new_len && old[first] == new[first])
+    first++;
+  end = new_len;
+  if (new_len == old_len)
+    {
+      while (end > first && old[end - 1] == new[end - 1])
+        end--;
+    }
+
+  elog_debug ("%s: writing %zu bytes at %zu, size %zu -> %zu\n", __func__,
+              end - first, first, old_len, new_len);
+  if (end > first && !write_at (fd, new + first, end - first, first))
+    {
+      elog_error ("Failed to write %s: %s\n", path, strerror (errno));
+      goto _ret;
+    }
+#ifdef WINDOWS
+  if (new_len < old_len && _chsize_s (fd, new_len) != 0)
+#else
+  if (new_len < old_len && ftruncate (fd, (off_t) new_len) == -1)
+#endif
+    {
+      elog_error ("Failed to truncate %s: %s\n", path, strerror (errno));
+      goto _ret;
+    }
+
+  /* The browser knows this content. The events caused by the write must not
+     be echoed back. */
+  if (baseline != NULL)
+    file_baseline_set (baseline, new, new_len);
+  success = true;
+
+_ret:
+  if (fd != -1) close (fd);
+  if (old != NULL) free (old);
+  if (new != NULL) free (new);
+
+  return success;
+}
+
+bool
+file_replace_text (const char *path, const char *text, size_t len,
+                   file_baseline_t *baseline)
+{
+  return replace_file_range (path, true, 0, 0, text, len, baseline);
+}
+
+bool
+file_replace_range (const char *path, size_t offset, size_t length,
+                    const char *text, size_t len, file_baseline_t *baseline)
+{
+  return replace_file_range (path, false, offset, length, text, len,
+                             baseline);
+}
+
+/* Selects the I/O backend on first use */
+static bool
+use_io_uring (void)
+{
+#ifdef HAVE_IO_URING
+  static bool initialized = false;
+
+  if (!initialized)
+    {
+      initialized = true;
+      uring_init ();
+    }
+  return uring_available ();
+#else
+  return false;
+#endif
+}
+
+/* Reads an entire file with plain syscalls */
+static char *
+read_file_syscalls (const char *path, size_t *len)
+{
+  int fd = -1;
+  char *text = NULL;
+
+  /* We need to open file in binary mode in Windows because otherwise the C
+   * runtime may transform the data as it is read. */
+  fd = open (path, O_RDONLY | O_BINARY_FLAG);
+  if (fd == -1)
+    {
+      elog_error ("%s: Failed to open file %s: %s\n", __func__, path,
+                  strerror (errno));
+      return NULL;
+    }
+
+  text = read_file_from_fd (fd, len);
+  close (fd);
+  if (text != NULL)
+    BEECTL_PROBE2 (snapshot_read, path, *len);
+
+  return text;
+}
+
+char *
+read_file (const char *path, size_t *len)
+{
+#ifdef HAVE_IO_URING
+  if (use_io_uring ())
+    {
+      char *text = uring_read_file (path, len, NULL, NULL);
+
+      if (text != NULL)
+        {
+          BEECTL_PROBE2 (snapshot_read, path, *len);
+          return text;
+        }
+      /* The plain syscalls report the error, if it's not specific to the
+         ring */
+      elog_debug ("%s: io_uring read of %s failed: %s\n", __func__, path,
+                  strerror (errno));
+    }
+#endif
+
+  return read_file_syscalls (path, len);
+}
+
+static void
+stamp_from_stat (const struct stat *st, file_stamp_t *stamp)
+{
+  stamp->dev = st->st_dev;
+  stamp->ino = st->st_ino;
+  stamp->size = st->st_size;
+  stamp->mtime_sec = st->st_mtime;
+#if defined(__APPLE__)
+  stamp->mtime_nsec = st->st_mtimespec.tv_nsec;
+#elif defined(WINDOWS)
+  stamp->mtime_nsec = 0;
+#else
+  stamp->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+}
+
+static bool
+get_file_stamp (const char *path, file_stamp_t *stamp)
+{
+  struct stat st;
+
+  if (stat (path, &st) == -1)
+    return false;
+  stamp_from_stat (&st, stamp);
+  return true;
+}
+
+/* Returns true if the stamps describe the same file with the same size and
+   modification time */
+static bool
+is_same_stamp (const file_stamp_t *a, const file_stamp_t *b)
+{
+  return a->dev == b->dev && a->ino == b->ino && a->size == b->size
+         && a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+/* Returns true if the file at `path` is still the one described by `before`,
+   with the same size and modification time */
+static bool
+is_file_unchanged (const char *path, const file_stamp_t *before)
+{
+  file_stamp_t after;
+
+  return get_file_stamp (path, &after) && is_same_stamp (before, &after);
+}
+
+static void
+count_torn_read (const char *path, size_t len)
+{
+  num_torn_reads++;
+  elog_debug ("%s changed while being read; retrying later\n", path);
+  BEECTL_PROBE2 (torn_read, path, len);
+}
+
+/* Returns true if the file has become smaller than `baseline` since the
+   last read, i.e. it may have been truncated by a writer which hasn't
+   finished yet. The shrink is recorded, and it is confirmed by the next read
+   which finds the same size and modification time. */
+static bool
+is_shrink_pending (file_baseline_t *baseline, const file_stamp_t *stamp)
+{
+  if (baseline == NULL || !baseline->valid
+      || (size_t) stamp->size >= baseline->size)
+    return false;
+
+  if (baseline->shrunk && baseline->shrunk_size == (size_t) stamp->size
+      && baseline->shrunk_mtime_sec == stamp->mtime_sec
+      && baseline->shrunk_mtime_nsec == stamp->mtime_nsec)
+    return false;
+
+  baseline->shrunk = true;
+  baseline->shrunk_size = stamp->size;
+  baseline->shrunk_mtime_sec = stamp->mtime_sec;
+  baseline->shrunk_mtime_nsec = stamp->mtime_nsec;
+  return true;
+}
+
+/* Reads an entire file, like read_file(), unless the file is being written.
+
+   An editor writing in place (truncating the file, then writing it in
+   chunks) may be caught in the middle. If the file is replaced, or its size
+   or modification time changes during the read, or the read doesn't match
+   the size, the snapshot is discarded: NULL is returned, and `torn` is set
+   to true.
+
+   The stamps only catch the writes which overlap the read. A writer pausing
+   between the truncation and the rest of its writes leaves a file which
+   looks complete, but is smaller than the content last seen. So if
+   `baseline` is not NULL, a shrunk file is discarded the same way until it
+   is found unchanged by the next read. A writer pausing longer than that
+   still goes unnoticed. */
+static char *
+read_file_snapshot (const char *path, size_t *len, file_baseline_t *baseline,
+                    bool *torn)
+{
+  file_stamp_t before;
+  file_stamp_t after;
+  char *text = NULL;
+
+  *torn = false;
+#ifdef HAVE_IO_URING
+  if (use_io_uring ())
+    {
+      struct stat st_before;
+      struct stat st_after;
+
+      /* The stamps are taken by the same submission as the read */
+      text = uring_read_file (path, len, &st_before, &st_after);
+      if (text != NULL)
+        {
+          BEECTL_PROBE2 (snapshot_read, path, *len);
+          stamp_from_stat (&st_before, &before);
+          stamp_from_stat (&st_after, &after);
+        }
+      else
+        elog_debug ("%s: io_uring read of %s failed: %s\n", __func__, path,
+                    strerror (errno));
+    }
+#endif
+
+  if (text == NULL)
+    {
+      if (!get_file_stamp (path, &before))
+        return read_file_syscalls (path, len);
+
+      text = read_file_syscalls (path, len);
+      if (text == NULL)
+        return NULL;
+
+      /* A file removed after the read counts as changed */
+      if (!get_file_stamp (path, &after))
+        memset (&after, 0, sizeof (after));
+    }
+
+  if ((off_t) *len != before.size || !is_same_stamp (&before, &after))
+    count_torn_read (path, *len);
+  else if (is_shrink_pending (baseline, &before))
+    {
+      num_torn_reads++;
+      elog_debug ("%s shrank from %zu to %zu bytes; retrying later\n", path,
+                  baseline->size, *len);
+      BEECTL_PROBE2 (torn_read, path, *len);
+    }
+  else
+    return text;
+
+  free (text);
+  *torn = true;
+  return NULL;
+}
+
+uint64_t
+get_num_torn_reads (void)
+{
+  return num_torn_reads;
+}
+
+bool
+write_frame (const char *body, uint32_t len)
+{
+#ifdef HAVE_IO_URING
+  if (use_io_uring ())
+    {
+      size_t written = 0;
+
+      if (uring_write_frame (STDOUT_FILENO, body, len, &written))
+        {
+          BEECTL_PROBE1 (frame_written, len);
+          return true;
+        }
+      /* A frame already started can't be written again */
+      if (written > 0)
+        {
+          elog_error ("Failed to write response: %s\n", strerror (errno));
+          return false;
+        }
+      elog_debug ("%s: io_uring write failed: %s\n", __func__,
+                  strerror (errno));
+    }
+#endif
+
+#ifdef WINDOWS
+  elog_debug ("writing response size\n");
+  if (unlikely (write (STDOUT_FILENO, &len, sizeof (uint32_t)) != sizeof (uint32_t)))
+    {
+      elog_error ("Failed to write response size: %s\n", strerror (errno));
+      return false;
+    }
+
+  elog_debug ("writing response body (length %u)\n", len);
+  if (unlikely (write (STDOUT_FILENO, body, len) != len))
+    {
+      elog_error ("Failed to write response body: %s\n", strerror (errno));
+      return false;
+    }
+#else
+  {
+    struct iovec iov[2];
+    size_t total = sizeof (len) + len;
+    size_t written = 0;
+
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof (len);
+    iov[1].iov_base = (void *) body;
+    iov[1].iov_len = len;
+
+    elog_debug ("writing response (length %u)\n", len);
+    while (written < total)
+      {
+        ssize_t n;
+
+        if (written == 0)
+          n = writev (STDOUT_FILENO, iov, 2);
+        else if (written < sizeof (len))
+          n = write (STDOUT_FILENO, (char *) &len + written,
+                     sizeof (len) - written);
+        else
+          n = write (STDOUT_FILENO, body + (written - sizeof (len)),
+                     total - written);
+
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n <= 0)
+          {
+            elog_error ("Failed to write response: %s\n", strerror (errno));
+            return false;
+          }
+        written += (size_t) n;
+      }
+  }
+#endif
+
+  BEECTL_PROBE1 (frame_written, len);
+  return true;
+}
+
+void
+set_response_fallback_encoding (utf8_fallback_t fallback)
+{
+  response_fallback = fallback;
+}
+
+void
+set_response_append (bool enable)
+{
+  response_append = enable;
+}
+
+/* Converts `len` bytes of `text` into the UTF-8 without BOM expected by the
+   browser. The result is saved into `body` and `body_len`. If the text had
+   to be converted, `repaired` is set to the memory to be freed.
+
+   Returns RESPONSE_INCOMPLETE if the text ends with an incomplete UTF-8
+   sequence and `final` is false, RESPONSE_FAILED on error, RESPONSE_SENT
+   otherwise. */
+static response_status_t
+text_to_utf8 (const char *text, size_t len, bool final,
+              const char **body, size_t *body_len, char **repaired)
+{
+  *body = text;
+  *body_len = len;
+  *repaired = NULL;
+
+  if (*body_len >= UTF8_BOM_LEN && !memcmp (*body, UTF8_BOM, UTF8_BOM_LEN))
+    {
+      *body += UTF8_BOM_LEN;
+      *body_len -= UTF8_BOM_LEN;
+    }
+
+  switch (utf8_validate (*body, *body_len))
+    {
+    case UTF8_VALID:
+      break;
+    case UTF8_TRUNCATED:
+      if (!final)
+        {
+          elog_debug ("%s: the text ends with an incomplete UTF-8 sequence; "
+                      "it is probably being written\n", __func__);
+          return RESPONSE_INCOMPLETE;
+        }
+      /* fallthrough */
+    default:
+      elog_debug ("%s: the text is not valid UTF-8; converting\n", __func__);
+      *repaired = utf8_repair (*body, *body_len, response_fallback, body_len);
+      if (unlikely (*repaired == NULL))
+        {
+          elog_error ("Failed to convert the text to UTF-8\n");
+          return RESPONSE_FAILED;
+        }
+      *body = *repaired;
+    }
+
+  return RESPONSE_SENT;
+}
+
+response_status_t
+send_text_response (const char *id, const char *text, size_t len, bool final)
+{
+  const char *body = NULL;
+  size_t body_len = 0;
+  char *repaired = NULL;
+  char *response = NULL;
+  uint32_t json_size = 0;
+  response_status_t status;
+
+  status = text_to_utf8 (text, len, final, &body, &body_len, &repaired);
+  if (status != RESPONSE_SENT)
+    return status;
+  status = RESPONSE_FAILED;
+
+  if (id != NULL)
+    {
+      json_field_t field = { .id = id, .text = body, .len = body_len };
+      response = json_make_fields_object (&field, 1, &json_size);
+    }
+  else
+    response = make_text_response (body, body_len, &json_size);
+  if (response == NULL)
+    {
+      elog_debug ("Failed to create response\n");
+      goto _ret;
+    }
+
+  json_size--; /* exclude trailing \0 */
+  BEECTL_PROBE1 (encode_done, json_size);
+
+  if (write_frame (response, json_size))
+    status = RESPONSE_SENT;
+
+_ret:
+  if (response != NULL) free (response);
+  if (repaired != NULL) free (repaired);
+
+  return status;
+}
+
+bool
+send_ready_response (uint64_t latency_ns)
+{
+  char response[64];
+  int n = snprintf (response, sizeof (response),
+                    "{\"status\":\"ready\",\"latency_ms\":%.3f}",
+                    latency_ns / 1e6);
+
+  if (unlikely (n < 0 || (size_t) n >= sizeof (response)))
+    return false;
+  return write_frame (response, (uint32_t) n);
+}
+
+bool
+send_error_response (const char *code, const char *message)
+{
+  static const char head[] = "{\"error\":{\"code\":\"";
+  static const char middle[] = "\",\"message\":\"";
+  static const char tail[] = "\"}}";
+  const size_t code_len = strlen (code);
+  const size_t message_len = strlen (message);
+  char *response = NULL;
+  char *p;
+  bool success;
+
+  response = malloc (sizeof (head) + sizeof (middle) + sizeof (tail)
+                     + json_escaped_len (code, code_len)
+                     + json_escaped_len (message, message_len));
+  if (unlikely (response == NULL))
+    {
+      perror ("malloc");
+      return false;
+    }
+
+  memcpy (response, head, sizeof (head) - 1);
+  p = json_escape (response + sizeof (head) - 1, code, code_len);
+  memcpy (p, middle, sizeof (middle) - 1);
+  p = json_escape (p + sizeof (middle) - 1, message, message_len);
+  memcpy (p, tail, sizeof (tail) - 1);
+  p += sizeof (tail) - 1;
+
+  success = write_frame (response, (uint32_t) (p - response));
+  free (response);
+  return success;
+}
+
+/* Sends the bytes appended to the file since the baseline as
+   {"append":"..."}, reading only them and the end of the baseline content.
+
+   Sets `*sent` to false if the file can't be sent this way: it hasn't grown,
+   the end of the baseline content has changed, or the new bytes need
+   conversion. The whole file has to be sent then. */
+static response_status_t
+send_append_response (const char *path, file_baseline_t *baseline,
+                      bool *sent)
+{
+  int fd = -1;
+  struct stat st;
+  char *buf = NULL;
+  size_t window = 0;
+  size_t added = 0;
+  const char *appended = NULL;
+  file_stamp_t before;
+  char *response = NULL;
+  uint32_t json_size = 0;
+  response_status_t status = RESPONSE_FAILED;
+
+  *sent = false;
+
+  fd = open (path, O_RDONLY | O_BINARY_FLAG);
+  if (fd == -1 || fstat (fd, &st) == -1)
+    goto _ret;
+  /* The first bytes of a file may be a BOM, which isn't sent */
+  if (baseline->size == 0 || (size_t) st.st_size <= baseline->size)
+    goto _ret;
+
+  window = baseline->size < APPEND_WINDOW ? baseline->size : APPEND_WINDOW;
+  added = (size_t) st.st_size - baseline->size;
+  buf = malloc (window + added);
+  if (unlikely (buf == NULL))
+    {
+      perror ("malloc");
+      goto _ret;
+    }
+  /* The end of the baseline content and the new bytes in one read. The file
+     may be truncated meanwhile. */
+  if (!read_at (fd, buf, window + added, baseline->size - window)
+      || str_hash (buf, window) != baseline->tail_hash)
+    goto _ret;
+  appended = buf + window;
+  BEECTL_PROBE2 (snapshot_read, path, added);
+
+  /* The writer may still be appending */
+  stamp_from_stat (&st, &before);
+  if (!is_file_unchanged (path, &before))
+    {
+      count_torn_read (path, added);
+      *sent = true;
+      status = RESPONSE_INCOMPLETE;
+      goto _ret;
+    }
+
+  switch (utf8_validate (appended, added))
+    {
+    case UTF8_VALID:
+      break;
+    case UTF8_TRUNCATED:
+      elog_debug ("%s: the appended text ends with an incomplete UTF-8 "
+                  "sequence; it is probably being written\n", __func__);
+      *sent = true;
+      status = RESPONSE_INCOMPLETE;
+      goto _ret;
+    default:
+      goto _ret;
+    }
+
+  elog_debug ("%s: %s grew by %zu bytes\n", __func__, path, added);
+  *sent = true;
+  response = json_make_string_object ("append", appended, added, &json_size);
+  if (response == NULL)
+    goto _ret;
+  json_size--; /* exclude trailing \0 */
+  BEECTL_PROBE1 (encode_done, json_size);
+  if (!write_frame (response, json_size))
+    goto _ret;
+  status = RESPONSE_SENT;
+
+  /* The last bytes of the new content are at the end of the buffer */
+  str_hash_update (&baseline->hash_state, appended, added);
+  baseline->size += added;
+  baseline->hash = str_hash_digest (&baseline->hash_state);
+  window = baseline->size < APPEND_WINDOW ? baseline->size : APPEND_WINDOW;
+  baseline->tail_hash = str_hash (appended + added - window, window);
+
+_ret:
+  if (fd != -1) close (fd);
+  if (buf != NULL) free (buf);
+  if (response != NULL) free (response);
+
+  return status;
+}
+
+response_status_t
+send_file_response (const char *filepath, file_baseline_t *baseline,
+                    bool final)
+{
+  char *text = NULL;
+  size_t text_len = 0;
+  uint64_t hash = 0;
+  response_status_t status = RESPONSE_FAILED;
+
+  elog_debug ("%s: making response file=%s\n", __func__, filepath);
+
+  if (baseline != NULL && baseline->appendable && !final)
+    {
+      bool sent = false;
+
+      status = send_append_response (filepath, baseline, &sent);
+      if (sent)
+        return status;
+    }
+
+  if (final)
+    text = read_file (filepath, &text_len);
+  else
+    {
+      bool torn = false;
+
+      text = read_file_snapshot (filepath, &text_len, baseline, &torn);
+      if (torn)
+        {
+          status = RESPONSE_INCOMPLETE;
+          goto _ret;
+        }
+    }
+  if (unlikely (text == NULL))
+    {
+      elog_debug ("Failed to read %s\n", filepath);
+      goto _ret;
+    }
+
+  if (baseline != NULL)
+    {
+      hash = str_hash (text, text_len);
+      if (baseline->valid && baseline->size == text_len
+          && baseline->hash == hash)
+        {
+          elog_debug ("%s: content of %s is unchanged (%zu bytes)\n",
+                      __func__, filepath, text_len);
+          status = RESPONSE_SKIPPED;
+          goto _ret;
+        }
+    }
+
+  status = send_text_response (NULL, text, text_len, final);
+
+  if (status == RESPONSE_SENT && baseline != NULL)
+    set_baseline (baseline, text, text_len, hash);
+
+_ret:
+  if (text != NULL) free (text);
+
+  return status;
+}
+
+response_status_t
+send_fields_response (field_t *fields, unsigned num_fields, bool final)
+{
+  json_field_t *items = NULL;
+  char **texts = NULL;
+  char **repaired = NULL;
+  uint64_t *hashes = NULL;
+  size_t *lens = NULL;
+  unsigned num_items = 0;
+  unsigned i;
+  char *response = NULL;
+  uint32_t json_size = 0;
+  bool incomplete = false;
+  response_status_t status = RESPONSE_FAILED;
+
+  items = calloc (num_fields, sizeof (*items));
+  texts = calloc (num_fields, sizeof (*texts));
+  repaired = calloc (num_fields, sizeof (*repaired));
+  hashes = calloc (num_fields, sizeof (*hashes));
+  lens = calloc (num_fields, sizeof (*lens));
+  if (unlikely (items == NULL || texts == NULL || repaired == NULL
+                || hashes == NULL || lens == NULL))
+    {
+      perror ("calloc");
+      goto _ret;
+    }
+
+  for (i = 0; i < num_fields; i++)
+    {
+      field_t *field = &fields[i];
+      response_status_t field_status;
+      bool field_final = final
+                         || field->incomplete_retries >= MAX_INCOMPLETE_RETRIES;
+      bool torn = false;
+
+      if (!final && !field->changed)
+        continue;
+
+      if (field_final)
+        texts[i] = read_file (field->path, &lens[i]);
+      else
+        texts[i] = read_file_snapshot (field->path, &lens[i],
+                                       &field->baseline, &torn);
+      if (torn)
+        {
+          /* Stays changed until the writer is done */
+          field->incomplete_retries++;
+          incomplete = true;
+          continue;
+        }
+      if (unlikely (texts[i] == NULL))
+        {
+          elog_debug ("Failed to read %s\n", field->path);
+          continue;
+        }
+
+      hashes[i] = str_hash (texts[i], lens[i]);
+      if (!final && field->baseline.valid && field->baseline.size == lens[i]
+          && field->baseline.hash == hashes[i])
+        {
+          elog_debug ("%s: content of %s is unchanged\n", __func__,
+                      field->path);
+          field->changed = false;
+          continue;
+        }
+
+      field_status = text_to_utf8 (texts[i], lens[i], field_final,
+                                   &items[num_items].text,
+                                   &items[num_items].len, &repaired[i]);
+      if (field_status == RESPONSE_INCOMPLETE)
+        {
+          /* Stays changed until the file is complete */
+          field->incomplete_retries++;
+          incomplete = true;
+          continue;
+        }
+      if (field_status != RESPONSE_SENT)
+        {
+          free (texts[i]);
+          texts[i] = NULL;
+          continue;
+        }
+
+      field->incomplete_retries = 0;
+      items[num_items].id = field->id;
+      num_items++;
+    }
+
+  if (num_items == 0)
+    {
+      status = incomplete ? RESPONSE_INCOMPLETE : RESPONSE_SKIPPED;
+      goto _ret;
+    }
+
+  /* All the changes saved at once are sent in a single message */
+  elog_debug ("%s: sending %u of %u fields\n", __func__, num_items,
+              num_fields);
+  response = json_make_fields_object (items, num_items, &json_size);
+  if (response == NULL)
+    goto _ret;
+
+  json_size--; /* exclude trailing \0 */
+  BEECTL_PROBE1 (encode_done, json_size);
+
+  if (!write_frame (response, json_size))
+    goto _ret;
+  status = incomplete ? RESPONSE_INCOMPLETE : RESPONSE_SENT;
+
+  for (i = 0; i < num_fields; i++)
+    {
+      field_t *field = &fields[i];
+
+      if (texts[i] == NULL || field->incomplete_retries)
+        continue;
+      set_baseline (&field->baseline, texts[i], lens[i], hashes[i]);
+      field->changed = false;
+    }
+
+_ret:
+  if (response != NULL) free (response);
+  for (i = 0; texts != NULL && i < num_fields; i++)
+    {
+      if (texts[i] != NULL) free (texts[i]);
+      if (repaired[i] != NULL) free (repaired[i]);
+    }
+  free (items);
+  free (texts);
+  free (repaired);
+  free (hashes);
+  free (lens);
+
+  return status;
 }
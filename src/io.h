@@ -42,6 +42,7 @@
 #endif
 
 #include "str.h"
+#include "utf8.h"
 
 /* Environment variable to override log file path */
 #define ELOG_ENV "BEECTL_DEBUG_LOG"
@@ -81,9 +82,41 @@ void elog_log (const char *level, const char *file, int line, const char *func,
    Returns the text read. The number of bytes read is assigned to `size`.
    On error, NULL is returned, and the value of `size` is undefined.
 
+   A request exceeding the frame size limit (see admission.h) is rejected
+   with an error response before its body is read. The memory is allocated
+   as the body arrives.
+
    The returned string must be freed by the caller. */
 char *read_browser_request (uint32_t *size);
 
+/* Accumulates native messaging frames which arrive in chunks of arbitrary
+   size, e.g. from a libuv stream */
+typedef struct _frame_reader_t {
+  char *buf;
+  size_t len;  /* Number of bytes received */
+  size_t size; /* Number of bytes allocated */
+  size_t skip; /* Number of bytes of a dropped frame still to come */
+} frame_reader_t;
+
+typedef void (*frame_cb_t) (char *body, uint32_t len, void *arg);
+
+/* Makes room for at least `hint` more bytes (the rest of the current frame,
+   if its length is known). Returns the free space at the end of the buffer;
+   its size is saved into `avail`. On error, NULL is returned. */
+char *frame_reader_reserve (frame_reader_t *reader, size_t hint,
+                            size_t *avail);
+
+/* Accounts for `n` bytes received into the space returned by
+   frame_reader_reserve(), and calls `cb` for every complete frame. The
+   callback may modify the body in place.
+
+   The frames exceeding the size limit (see admission.h) are dropped without
+   being stored. Returns the number of frames dropped. */
+unsigned frame_reader_consume (frame_reader_t *reader, size_t n,
+                               frame_cb_t cb, void *arg);
+
+void frame_reader_destroy (frame_reader_t *reader);
+
 /* Reads an entire file.
 
    Returns the text read from the file as a null-terminated string. The string
@@ -101,18 +134,194 @@ char *read_file_from_fd (int fd, size_t *len);
    On error, NULL is returned, and the value of len is undefined. */
 char *read_file_from_stream (FILE *stream, size_t *len);
 
-/* Creates and opens a temporary file.
+/* Reads an entire file by path. On Linux, io_uring is used if enabled.
+
+   Returns the text read from the file as a null-terminated string. The string
+   length is saved into `len`.
+
+   On error, NULL is returned, and the value of len is undefined. */
+char *read_file (const char *path, size_t *len);
+
+/* Writes a native messaging frame (the 32-bit length followed by the body)
+   to the standard output. Returns true on success. */
+bool write_frame (const char *body, uint32_t len);
+
+/* Sets `dir` to the private directory of the current user for the files
+   which outlive a session: $XDG_RUNTIME_DIR/beectl, or beectl-<uid> in the
+   system temporary directory. On Windows, the temporary directory is already
+   private, and beectl in it is used. The directory is created if it doesn't
+   exist. Returns false if it can't be created, or if it isn't private. */
+bool get_user_dir (str_t *dir);
+
+/* Creates and opens a temporary file in the `tmp_dir` directory. If
+   `tmp_dir->name` is NULL, it is set to the system temporary directory.
    Returns file descriptor.
    On error, -1 is returned, and errno is set appropriately */
 int open_tmp_file (char **out_path, str_t *tmp_dir, const char* ext, unsigned ext_len);
 
+/* Creates a directory private to the current session in the user directory
+   (see get_user_dir()). A lock file next to it is locked until the directory
+   is removed by remove_session_dir(), so that the directories of crashed
+   sessions can be found by sweep_session_dirs().
+   On success, `session_dir` is set to the pathname, and true is returned. */
+bool create_session_dir (str_t *session_dir);
+
+/* Removes a directory along with everything in it: files and directories
+   the editor left behind. If it's a session directory created by this
+   process, its lock file is removed and the lock released. */
+bool remove_session_dir (const char *path);
+
+/* Removes the session directories in the user directory whose lock files
+   aren't locked, i.e. left behind by processes that don't exist anymore */
+void sweep_session_dirs (void);
+
+/* Appends ".ext" to the name of a temporary file created by open_tmp_file()
+   without replacing an existing file. On success, the string pointed to by
+   `path` is replaced with the new pathname, and true is returned.
+   Renaming an open file is not supported on all platforms; on failure, the
+   file is left intact. */
+bool add_tmp_file_ext (char **path, const char *ext, unsigned ext_len);
+
+/* Asks the OS to start reading the file into the page cache, so that a
+   subsequent exec() or read() doesn't wait for the disk. No-op where the
+   platform offers no such hint. */
+void prefetch_file (const char *path);
+
 /* Removes file from filesystem */
 bool remove_file (const char* filename);
 
+/* Content of a file last seen by the browser: the text written to the
+   temporary file or the last text sent */
+typedef struct _file_baseline_t {
+  size_t size;
+  uint64_t hash; /* str_hash() of the content */
+  bool valid;
+  /* Set in the append mode (see set_response_append()) if the fields below
+     describe the content */
+  bool appendable;
+  /* str_hash() of the last APPEND_WINDOW bytes of the content */
+  uint64_t tail_hash;
+  /* Hash state after the content, to extend `hash` with appended bytes */
+  str_hash_state_t hash_state;
+  /* Set when a read found the file smaller than the content; the size and
+     modification time it had then */
+  bool shrunk;
+  size_t shrunk_size;
+  int64_t shrunk_mtime_sec;
+  long shrunk_mtime_nsec;
+} file_baseline_t;
+
+/* Size of the end of the content compared to decide that a file has only
+   been appended to */
+#define APPEND_WINDOW 4096
+
+/* Records `text` as the content known to the browser */
+void file_baseline_set (file_baseline_t *baseline, const char *text, size_t len);
+
+/* Replaces the content of the file with `len` bytes of `text`, writing only
+   the bytes that differ. If `baseline` is not NULL, it is set to the new
+   content. */
+bool file_replace_text (const char *path, const char *text, size_t len,
+                        file_baseline_t *baseline);
+
+/* Replaces `length` bytes at byte `offset` of the file with `len` bytes of
+   `text`, writing only the bytes that differ. Fails if the range is out of
+   the file bounds. If `baseline` is not NULL, it is set to the new
+   content. */
+bool file_replace_range (const char *path, size_t offset, size_t length,
+                         const char *text, size_t len,
+                         file_baseline_t *baseline);
+
+/* Generates response for the browser from `len` bytes of `text` */
+char *make_text_response (const char *text, size_t len, uint32_t *size);
+
 /* Generates response for the browser */
 char *make_response (int fd, uint32_t *size);
 
-/* Sends response to the browser */
-void send_file_response(const char *filepath);
+typedef enum _response_status_t {
+  RESPONSE_SENT = 0,
+  /* The content matches the baseline */
+  RESPONSE_SKIPPED,
+  /* The file is being written: it ends with an incomplete UTF-8 sequence,
+     or it changed while being read */
+  RESPONSE_INCOMPLETE,
+  RESPONSE_FAILED,
+} response_status_t;
+
+/* Sets the encoding assumed for the edited file if it isn't valid UTF-8 */
+void set_response_fallback_encoding (utf8_fallback_t fallback);
+
+/* Enables the append responses for the documents the editor only appends
+   to, e.g. logs. Must be called before the baselines are set.
+
+   If a file has grown and the last APPEND_WINDOW bytes known to the browser
+   are unchanged, send_file_response() reads only the new bytes and sends
+   {"append":"..."}. Otherwise, the whole file is sent as usual. Changes
+   before the window are not detected, so the browser should enable the mode
+   only for the documents which are never edited in the middle. */
+void set_response_append (bool enable);
+
+/* Sends `len` bytes of `text` to the browser. If `id` is not NULL, the text
+   is sent as the only item of a "fields" response (see
+   send_fields_response()).
+
+   The text is converted to UTF-8 without BOM. Unless `final` is true, a text
+   ending with an incomplete UTF-8 sequence is not sent. */
+response_status_t send_text_response (const char *id, const char *text,
+                                      size_t len, bool final);
+
+/* Sends the file content to the browser.
+
+   If `baseline` is not NULL, the response is sent only if the content differs
+   from the baseline, and the baseline is updated after sending.
+
+   The content is converted to UTF-8 without BOM. Unless `final` is true, a
+   file ending with an incomplete UTF-8 sequence, or changing while being
+   read, is not sent (RESPONSE_INCOMPLETE), as it is likely being written.
+   Neither is a file which has become smaller than the baseline, until a
+   later call finds it with the same size and modification time: an editor
+   writing in place truncates the file first. */
+response_status_t send_file_response (const char *filepath,
+                                      file_baseline_t *baseline, bool final);
+
+/* Tells the browser that its request has been rejected:
+   {"error":{"code":"...","message":"..."}} */
+bool send_error_response (const char *code, const char *message);
+
+/* Tells the browser that the editor has opened the file `latency_ns` after
+   it was spawned: {"status":"ready","latency_ms":N} */
+bool send_ready_response (uint64_t latency_ns);
+
+/* Returns the number of file reads discarded because the file changed
+   while being read */
+uint64_t get_num_torn_reads (void);
+
+/* How many times to re-read a file being written before sending it as it
+   is */
+#define MAX_INCOMPLETE_RETRIES 3
+
+/* A text field of the page edited in its own file */
+typedef struct _field_t {
+  char *id;
+  char *path;
+  file_baseline_t baseline;
+  /* Set when the file may have changed; cleared once the change is sent */
+  bool changed;
+  /* Number of successive reads which found the file incomplete */
+  unsigned incomplete_retries;
+  /* Last modification time seen when polling */
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+} field_t;
+
+/* Sends the content of the changed fields to the browser in a single
+   {"fields":[{"id":"...","text":"..."},...]} message.
+
+   Unless `final` is true, the fields which match their baselines are
+   skipped, and the files being written (see send_file_response()) are left
+   changed for a later call (RESPONSE_INCOMPLETE). If `final` is true, all
+   fields are sent. */
+response_status_t send_fields_response (field_t *fields, unsigned num_fields,
+                                        bool final);
 
 #endif /* __BEECTL_IO_H__ */
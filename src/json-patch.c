@@ -3,6 +3,21 @@
  *
  * Used in installation scripts.
  *
+ * Usage:
+ *
+ *   json-patch input-file json-text
+ *     Prints input-file merged with json-text (RFC 7386) to stdout.
+ *
+ *   json-patch -i input-file json-text [input-file json-text ...]
+ *   json-patch -i -l list-file
+ *   json-patch -i -g pattern json-text
+ *     Patches files in place. The files are taken from the command line,
+ *     from list-file ("-" for stdin) containing lines of the form
+ *     "input-file<TAB>json-text", or from a glob pattern. Identical patch
+ *     texts are parsed only once; files the patch doesn't change are left
+ *     untouched. A patched file replaces the original by means of rename()
+ *     from a temporary file in the same directory.
+ *
  * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
  *
  * Permission is hereby granted, free of charge, to any person obtaining
@@ -26,77 +41,442 @@
  */
 #include "common.h"
 #include "io.h"
-#include <stdio.h> /* fprintf fopen fclose */
-#include <string.h> /* strlen memcmp */
+#include "mkstemps.h"
+#include <stdio.h> /* fprintf fopen fclose rename */
+#include <string.h> /* strlen strcmp strchr */
 #include <stdlib.h> /* EXIT_SUCCESS EXIT_FAILURE */
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef WINDOWS
+# include <glob.h>
+#endif
 
 #include "cjson/cJSON.h"
 #include "cjson/cJSON_Utils.h"
 
-int
-main (int argc, char const* argv[])
+/* Suffix of the temporary file created next to the file being patched */
+#define TMP_SUFFIX_TEMPLATE ".XXXXXX"
+
+/* Maximum length of a line in the list file */
+#define LIST_LINE_MAX 8192
+
+/* Parsed patch documents, keyed by their source text */
+typedef struct _patch_cache_t {
+  char *text;
+  cJSON *patch;
+  struct _patch_cache_t *next;
+} patch_cache_t;
+
+typedef struct _batch_stats_t {
+  unsigned patched;
+  unsigned unchanged;
+  unsigned failed;
+} batch_stats_t;
+
+static void
+print_usage (const char *prog)
 {
-  int exit_code = EXIT_SUCCESS;
-  char *text = NULL;
-  char *obj_text = NULL;
-  size_t text_len = 0;
-  cJSON *input_obj = NULL;
-  cJSON *obj = NULL;
-  FILE *stream = NULL;
-  const char *error = NULL;
+  fprintf (stderr,
+           "Usage: %s input-file json-text\n"
+           "       %s -i input-file json-text [input-file json-text ...]\n"
+           "       %s -i -l list-file\n"
+           "       %s -i -g pattern json-text\n",
+           prog, prog, prog, prog);
+}
 
-  if (argc < 3)
-    {
-      fprintf (stderr, "Usage: %s input-file json-text\n", argv[0]);
-      return EXIT_FAILURE;
-    }
+static cJSON *
+parse_json (const char *text)
+{
+  const char *error = NULL;
+  cJSON *obj = cJSON_Parse (text);
 
-  input_obj = cJSON_Parse (argv[2]);
-  if (unlikely (input_obj == NULL))
+  if (unlikely (obj == NULL))
     {
       error = cJSON_GetErrorPtr ();
       if (likely (error != NULL))
         fprintf (stderr, "Failed parsing JSON: %s\n", error);
-      goto _ret;
     }
 
-  stream = fopen (argv[1], "r");
+  return obj;
+}
+
+/* Returns parsed patch for `text`, parsing it only on first use */
+static const cJSON *
+patch_cache_get (patch_cache_t **cache, const char *text)
+{
+  patch_cache_t *entry = NULL;
+  cJSON *patch = NULL;
+
+  for (entry = *cache; entry != NULL; entry = entry->next)
+    {
+      if (!strcmp (entry->text, text))
+        return entry->patch;
+    }
+
+  if ((patch = parse_json (text)) == NULL)
+    return NULL;
+
+  entry = malloc (sizeof (patch_cache_t));
+  if (unlikely (entry == NULL || (entry->text = strdup (text)) == NULL))
+    {
+      perror ("malloc");
+      free (entry);
+      cJSON_Delete (patch);
+      return NULL;
+    }
+  entry->patch = patch;
+  entry->next = *cache;
+  *cache = entry;
+
+  return patch;
+}
+
+static void
+patch_cache_destroy (patch_cache_t *cache)
+{
+  patch_cache_t *next = NULL;
+
+  for (; cache != NULL; cache = next)
+    {
+      next = cache->next;
+      cJSON_Delete (cache->patch);
+      free (cache->text);
+      free (cache);
+    }
+}
+
+/* Reads and parses JSON file */
+static cJSON *
+read_json_file (const char *filename, struct stat *st)
+{
+  FILE *stream = NULL;
+  char *text = NULL;
+  size_t text_len = 0;
+  cJSON *obj = NULL;
+
+  stream = fopen (filename, "rb");
   if (unlikely (stream == NULL))
     {
-      perror ("fopen");
+      fprintf (stderr, "%s: %s\n", filename, strerror (errno));
+      return NULL;
+    }
+
+  if (st != NULL && fstat (fileno (stream), st))
+    {
+      fprintf (stderr, "%s: fstat: %s\n", filename, strerror (errno));
       goto _ret;
     }
 
   text = read_file_from_stream (stream, &text_len);
   if (unlikely (text == NULL))
+    {
+      fprintf (stderr, "%s: failed to read file\n", filename);
+      goto _ret;
+    }
+
+  obj = parse_json (text);
+
+_ret:
+  if (fclose (stream))
+    perror ("fclose");
+  if (text != NULL) free (text);
+
+  return obj;
+}
+
+/* Atomically replaces `filename` with `text` via a temporary file in the same
+   directory. `mode` is applied to the new file. */
+static bool
+replace_file (const char *filename, const char *text, mode_t mode)
+{
+  bool success = false;
+  bool tmp_created = false;
+  int fd = -1;
+  size_t text_len = strlen (text);
+  size_t tmp_path_size = strlen (filename) + sizeof (TMP_SUFFIX_TEMPLATE);
+  char *tmp_path = malloc (tmp_path_size);
+
+  if (unlikely (tmp_path == NULL))
+    {
+      perror ("malloc");
+      return false;
+    }
+  snprintf (tmp_path, tmp_path_size, "%s" TMP_SUFFIX_TEMPLATE, filename);
+
+  fd = mkstemp (tmp_path);
+  if (fd == -1)
+    {
+      fprintf (stderr, "%s: mkstemp: %s\n", tmp_path, strerror (errno));
+      goto _ret;
+    }
+  tmp_created = true;
+
+  if (write (fd, text, text_len) != (ssize_t)text_len
+      || write (fd, "\n", 1) != 1)
+    {
+      fprintf (stderr, "%s: write: %s\n", tmp_path, strerror (errno));
+      goto _ret;
+    }
+
+#ifndef WINDOWS
+  if (fchmod (fd, mode & 07777))
+    {
+      fprintf (stderr, "%s: fchmod: %s\n", tmp_path, strerror (errno));
+      goto _ret;
+    }
+#endif
+
+  if (close (fd))
+    {
+      fd = -1;
+      fprintf (stderr, "%s: close: %s\n", tmp_path, strerror (errno));
+      goto _ret;
+    }
+  fd = -1;
+
+#ifdef WINDOWS
+  success = MoveFileExA (tmp_path, filename, MOVEFILE_REPLACE_EXISTING);
+  if (!success)
+    fprintf (stderr, "%s: MoveFileEx failed (%lu)\n", filename,
+             GetLastError ());
+#else
+  success = !rename (tmp_path, filename);
+  if (!success)
+    fprintf (stderr, "%s: rename: %s\n", filename, strerror (errno));
+#endif
+
+_ret:
+  if (fd != -1)
+    close (fd);
+  if (!success && tmp_created)
+    unlink (tmp_path);
+  free (tmp_path);
+
+  return success;
+}
+
+/* Merges `patch_text` into `filename` in place */
+static void
+patch_file (const char *filename, const char *patch_text,
+            patch_cache_t **cache, batch_stats_t *stats)
+{
+  struct stat st;
+  const cJSON *patch = NULL;
+  cJSON *obj = NULL;
+  cJSON *orig_obj = NULL;
+  char *obj_text = NULL;
+  bool success = false;
+
+  if ((patch = patch_cache_get (cache, patch_text)) == NULL)
     goto _ret;
 
-  obj = cJSON_Parse (text);
-  if (unlikely (obj == NULL))
+  if ((obj = read_json_file (filename, &st)) == NULL)
+    goto _ret;
+
+  orig_obj = cJSON_Duplicate (obj, true);
+  if (unlikely (orig_obj == NULL))
     {
-      error = cJSON_GetErrorPtr ();
-      if (likely (error != NULL))
-        fprintf (stderr, "Failed parsing JSON: %s\n", error);
+      fprintf (stderr, "%s: failed to copy JSON\n", filename);
       goto _ret;
     }
 
-  if (unlikely (cJSONUtils_MergePatch(obj, input_obj) == NULL))
+  if (unlikely ((obj = cJSONUtils_MergePatch (obj, patch)) == NULL))
+    {
+      fprintf (stderr, "%s: failed merging input JSON\n", filename);
+      goto _ret;
+    }
+
+  if (cJSON_Compare (orig_obj, obj, true))
+    {
+      stats->unchanged++;
+      success = true;
+      goto _ret;
+    }
+
+  obj_text = cJSON_Print (obj);
+  if (unlikely (obj_text == NULL))
+    {
+      fprintf (stderr, "%s: failed converting JSON to string\n", filename);
+      goto _ret;
+    }
+
+  if ((success = replace_file (filename, obj_text, st.st_mode)))
+    stats->patched++;
+
+_ret:
+  if (!success)
+    stats->failed++;
+  if (obj != NULL) cJSON_Delete (obj);
+  if (orig_obj != NULL) cJSON_Delete (orig_obj);
+  if (obj_text != NULL) free (obj_text);
+}
+
+/* Processes "input-file<TAB>json-text" lines */
+static bool
+patch_files_from_list (const char *list_filename,
+                       patch_cache_t **cache, batch_stats_t *stats)
+{
+  char line[LIST_LINE_MAX];
+  char *sep = NULL;
+  size_t len = 0;
+  unsigned line_num = 0;
+  FILE *stream = NULL;
+
+  if (!strcmp (list_filename, "-"))
+    stream = stdin;
+  else if ((stream = fopen (list_filename, "r")) == NULL)
+    {
+      fprintf (stderr, "%s: %s\n", list_filename, strerror (errno));
+      return false;
+    }
+
+  while (fgets (line, sizeof (line), stream) != NULL)
+    {
+      line_num++;
+      len = strlen (line);
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+      if (len == 0)
+        continue;
+
+      if ((sep = strchr (line, '\t')) == NULL)
+        {
+          fprintf (stderr, "%s:%u: expected \"input-file<TAB>json-text\"\n",
+                   list_filename, line_num);
+          stats->failed++;
+          continue;
+        }
+      *sep = '\0';
+
+      patch_file (line, sep + 1, cache, stats);
+    }
+
+  if (stream != stdin)
+    fclose (stream);
+
+  return true;
+}
+
+static bool
+patch_files_from_glob (const char *pattern, const char *patch_text,
+                       patch_cache_t **cache, batch_stats_t *stats)
+{
+#ifdef WINDOWS
+  fprintf (stderr, "Glob patterns are not supported on this platform\n");
+  return false;
+#else
+  glob_t g;
+  int rc = glob (pattern, 0, NULL, &g);
+
+  if (rc == GLOB_NOMATCH)
+    return true;
+  if (rc != 0)
+    {
+      fprintf (stderr, "%s: glob failed\n", pattern);
+      return false;
+    }
+
+  for (size_t i = 0; i < g.gl_pathc; i++)
+    patch_file (g.gl_pathv[i], patch_text, cache, stats);
+
+  globfree (&g);
+  return true;
+#endif
+}
+
+/* Prints `input_file` merged with `patch_text` to stdout */
+static int
+patch_to_stdout (const char *input_file, const char *patch_text)
+{
+  int exit_code = EXIT_FAILURE;
+  char *obj_text = NULL;
+  cJSON *input_obj = NULL;
+  cJSON *obj = NULL;
+
+  input_obj = parse_json (patch_text);
+  if (unlikely (input_obj == NULL))
+    goto _ret;
+
+  obj = read_json_file (input_file, NULL);
+  if (unlikely (obj == NULL))
+    goto _ret;
+
+  if (unlikely ((obj = cJSONUtils_MergePatch (obj, input_obj)) == NULL))
     {
       perror ("Failed merging input JSON");
       goto _ret;
     }
 
   obj_text = cJSON_Print (obj);
+  if (unlikely (obj_text == NULL))
+    goto _ret;
+
+  printf ("%s\n", obj_text);
+  exit_code = EXIT_SUCCESS;
 
-  printf("%s\n", obj_text);
 _ret:
   if (input_obj != NULL) cJSON_Delete (input_obj);
-  if (stream != NULL && fclose (stream))
-    perror ("fclose");
-  if (text != NULL) free (text);
   if (obj != NULL) cJSON_Delete (obj);
   if (obj_text != NULL) free (obj_text);
 
   return exit_code;
 }
+
+int
+main (int argc, char const* argv[])
+{
+  int i = 1;
+  bool ok = true;
+  const char *list_filename = NULL;
+  const char *pattern = NULL;
+  patch_cache_t *cache = NULL;
+  batch_stats_t stats = { 0 };
+
+  if (argc < 3)
+    {
+      print_usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (strcmp (argv[1], "-i"))
+    {
+      if (argc != 3)
+        {
+          print_usage (argv[0]);
+          return EXIT_FAILURE;
+        }
+      return patch_to_stdout (argv[1], argv[2]);
+    }
+
+  i = 2;
+  if (!strcmp (argv[i], "-l") && argc == 4)
+    list_filename = argv[3];
+  else if (!strcmp (argv[i], "-g") && argc == 5)
+    pattern = argv[3];
+  else if (argv[i][0] == '-' || (argc - i) % 2)
+    {
+      print_usage (argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  if (list_filename != NULL)
+    ok = patch_files_from_list (list_filename, &cache, &stats);
+  else if (pattern != NULL)
+    ok = patch_files_from_glob (pattern, argv[4], &cache, &stats);
+  else
+    {
+      for (; i + 1 < argc; i += 2)
+        patch_file (argv[i], argv[i + 1], &cache, &stats);
+    }
+
+  patch_cache_destroy (cache);
+
+  if (stats.failed)
+    fprintf (stderr, "Patched %u, unchanged %u, failed %u file(s)\n",
+             stats.patched, stats.unchanged, stats.failed);
+
+  return ok && !stats.failed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,808 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * JSON encoding helpers.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "json.h"
+#include "common.h"
+#include "io.h" /* elog_* */
+#include "simd.h"
+
+#include <stdbool.h>
+#include <stdlib.h> /* getenv malloc free strtoul */
+#include <string.h> /* memcpy memset memcmp strlen */
+
+#include <uv.h>
+
+/* For every byte, the character following the backslash in its escape
+   sequence, 'u' for \u00XX, or 0 if the byte is copied as is */
+static const char escape_table[256] = {
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+  'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+  0, 0, '"', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, '\\', 0, 0, 0,
+  /* The rest are zeroes */
+};
+
+static const char hex_digits[] = "0123456789abcdef";
+
+/* Scanning kernels.
+
+   An escape kernel returns the offset of the first byte in `p` which needs
+   escaping ('"', '\\' or < 0x20), or `len` if there is none. A string kernel
+   returns the offset of the first '"' or '\\'. Typical texts have few such
+   bytes, so the vector kernels let us skip and copy long runs in bulk. */
+typedef size_t (*json_scan_fn) (const unsigned char *p, size_t len);
+
+static json_scan_fn scan_escape;
+static json_scan_fn scan_string;
+static uv_once_t scan_init_once = UV_ONCE_INIT;
+
+static size_t
+scan_escape_scalar (const unsigned char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (escape_table[p[i]])
+      break;
+
+  return i;
+}
+
+static size_t
+scan_string_scalar (const unsigned char *p, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (p[i] == '"' || p[i] == '\\')
+      break;
+
+  return i;
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET ("sse2") static size_t
+scan_escape_sse2 (const unsigned char *p, size_t len)
+{
+  const __m128i quote = _mm_set1_epi8 ('"');
+  const __m128i backslash = _mm_set1_epi8 ('\\');
+  const __m128i control_max = _mm_set1_epi8 (0x1f);
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (p + i));
+      __m128i m = _mm_or_si128 (
+        _mm_or_si128 (_mm_cmpeq_epi8 (v, quote), _mm_cmpeq_epi8 (v, backslash)),
+        _mm_cmpeq_epi8 (_mm_min_epu8 (v, control_max), v));
+      unsigned mask = (unsigned) _mm_movemask_epi8 (m);
+
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_escape_scalar (p + i, len - i);
+}
+
+SIMD_TARGET ("sse2") static size_t
+scan_string_sse2 (const unsigned char *p, size_t len)
+{
+  const __m128i quote = _mm_set1_epi8 ('"');
+  const __m128i backslash = _mm_set1_epi8 ('\\');
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    {
+      __m128i v = _mm_loadu_si128 ((const __m128i *) (p + i));
+      unsigned mask = (unsigned) _mm_movemask_epi8 (
+        _mm_or_si128 (_mm_cmpeq_epi8 (v, quote), _mm_cmpeq_epi8 (v, backslash)));
+
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_string_scalar (p + i, len - i);
+}
+
+# ifdef SIMD_HAVE_AVX2
+SIMD_TARGET ("avx2") static size_t
+scan_escape_avx2 (const unsigned char *p, size_t len)
+{
+  const __m256i quote = _mm256_set1_epi8 ('"');
+  const __m256i backslash = _mm256_set1_epi8 ('\\');
+  const __m256i control_max = _mm256_set1_epi8 (0x1f);
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+      __m256i m = _mm256_or_si256 (
+        _mm256_or_si256 (_mm256_cmpeq_epi8 (v, quote),
+                         _mm256_cmpeq_epi8 (v, backslash)),
+        _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, control_max), v));
+      unsigned mask = (unsigned) _mm256_movemask_epi8 (m);
+
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_escape_sse2 (p + i, len - i);
+}
+
+SIMD_TARGET ("avx2") static size_t
+scan_string_avx2 (const unsigned char *p, size_t len)
+{
+  const __m256i quote = _mm256_set1_epi8 ('"');
+  const __m256i backslash = _mm256_set1_epi8 ('\\');
+  size_t i = 0;
+
+  for (; i + 32 <= len; i += 32)
+    {
+      __m256i v = _mm256_loadu_si256 ((const __m256i *) (p + i));
+      unsigned mask = (unsigned) _mm256_movemask_epi8 (
+        _mm256_or_si256 (_mm256_cmpeq_epi8 (v, quote),
+                         _mm256_cmpeq_epi8 (v, backslash)));
+
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_string_sse2 (p + i, len - i);
+}
+# endif /* SIMD_HAVE_AVX2 */
+#endif /* SIMD_X86 */
+
+static void
+init_scan_kernels (void)
+{
+  switch (simd_get_level ())
+    {
+#if defined(SIMD_X86)
+# ifdef SIMD_HAVE_AVX2
+    case SIMD_AVX2:
+      scan_escape = scan_escape_avx2;
+      scan_string = scan_string_avx2;
+      break;
+# endif
+    case SIMD_SSE2:
+      scan_escape = scan_escape_sse2;
+      scan_string = scan_string_sse2;
+      break;
+#endif
+    default:
+      scan_escape = scan_escape_scalar;
+      scan_string = scan_string_scalar;
+    }
+}
+
+size_t
+json_escaped_len (const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char * const end = p + len;
+  size_t out_len = len;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  for (;;)
+    {
+      p += scan_escape (p, end - p);
+      if (p == end)
+        break;
+      out_len += escape_table[*p] == 'u' ? 5 : 1;
+      p++;
+    }
+
+  return out_len;
+}
+
+char *
+json_escape (char *out, const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char * const end = p + len;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  for (;;)
+    {
+      /* Copy the run of bytes which don't need escaping */
+      size_t run = scan_escape (p, end - p);
+      char c;
+
+      memcpy (out, p, run);
+      out += run;
+      p += run;
+      if (p == end)
+        break;
+
+      c = escape_table[*p];
+      *out++ = '\\';
+      *out++ = c;
+      if (c == 'u')
+        {
+          *out++ = '0';
+          *out++ = '0';
+          *out++ = hex_digits[*p >> 4];
+          *out++ = hex_digits[*p & 0xf];
+        }
+      p++;
+    }
+
+  return out;
+}
+
+/* Parses 4 hex digits */
+static bool
+parse_hex4 (const unsigned char *p, unsigned *value)
+{
+  unsigned v = 0;
+  int i;
+
+  for (i = 0; i < 4; i++)
+    {
+      unsigned c = p[i];
+
+      if (c >= '0' && c <= '9')
+        c -= '0';
+      else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+        c = (c | 0x20) - 'a' + 10;
+      else
+        return false;
+      v = (v << 4) | c;
+    }
+
+  *value = v;
+  return true;
+}
+
+char *
+json_unescape (char *out, const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char * const end = p + len;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  for (;;)
+    {
+      size_t run = scan_string (p, end - p);
+      unsigned cp;
+
+      memcpy (out, p, run);
+      out += run;
+      p += run;
+      if (p == end)
+        break;
+      if (*p == '"' || p + 1 == end)
+        return NULL;
+
+      p++;
+      switch (*p++)
+        {
+        case '"': *out++ = '"'; continue;
+        case '\\': *out++ = '\\'; continue;
+        case '/': *out++ = '/'; continue;
+        case 'b': *out++ = '\b'; continue;
+        case 'f': *out++ = '\f'; continue;
+        case 'n': *out++ = '\n'; continue;
+        case 'r': *out++ = '\r'; continue;
+        case 't': *out++ = '\t'; continue;
+        case 'u': break;
+        default: return NULL;
+        }
+
+      if (end - p < 4 || !parse_hex4 (p, &cp))
+        return NULL;
+      p += 4;
+
+      if (cp >= 0xdc00 && cp <= 0xdfff)
+        return NULL;
+      if (cp >= 0xd800 && cp <= 0xdbff)
+        {
+          unsigned low;
+
+          if (end - p < 6 || p[0] != '\\' || p[1] != 'u'
+              || !parse_hex4 (p + 2, &low) || low < 0xdc00 || low > 0xdfff)
+            return NULL;
+          p += 6;
+          cp = 0x10000 + (((cp & 0x3ff) << 10) | (low & 0x3ff));
+        }
+
+      if (cp < 0x80)
+        *out++ = (char) cp;
+      else if (cp < 0x800)
+        {
+          *out++ = (char) (0xc0 | (cp >> 6));
+          *out++ = (char) (0x80 | (cp & 0x3f));
+        }
+      else if (cp < 0x10000)
+        {
+          *out++ = (char) (0xe0 | (cp >> 12));
+          *out++ = (char) (0x80 | ((cp >> 6) & 0x3f));
+          *out++ = (char) (0x80 | (cp & 0x3f));
+        }
+      else
+        {
+          *out++ = (char) (0xf0 | (cp >> 18));
+          *out++ = (char) (0x80 | ((cp >> 12) & 0x3f));
+          *out++ = (char) (0x80 | ((cp >> 6) & 0x3f));
+          *out++ = (char) (0x80 | (cp & 0x3f));
+        }
+    }
+
+  return out;
+}
+
+static const char *
+skip_whitespace (const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    p++;
+  return p;
+}
+
+/* Returns a pointer to the closing quote of the string starting at `p` (the
+   opening quote), or NULL if the string is not terminated */
+static const char *
+find_string_end (const char *p, const char *end)
+{
+  p++;
+  for (;;)
+    {
+      p += scan_string ((const unsigned char *) p, end - p);
+      if (p == end)
+        return NULL;
+      if (*p == '"')
+        return p;
+      p += 2; /* Skip the escaped character */
+      if (p >= end)
+        return NULL;
+    }
+}
+
+/* Skips a JSON value without validating it. Returns a pointer to the byte
+   following the value, or NULL on error. */
+static const char *
+skip_value (const char *p, const char *end)
+{
+  unsigned depth = 0;
+
+  do
+    {
+      if (p == end)
+        return NULL;
+
+      switch (*p)
+        {
+        case '"':
+          if ((p = find_string_end (p, end)) == NULL)
+            return NULL;
+          p++;
+          break;
+        case '{':
+        case '[':
+          depth++;
+          p++;
+          break;
+        case '}':
+        case ']':
+          if (depth == 0)
+            return NULL;
+          depth--;
+          p++;
+          break;
+        default:
+          if (depth == 0)
+            {
+              /* Number or literal */
+              while (p < end && *p != ',' && *p != '}' && *p != ']'
+                     && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r')
+                p++;
+              return p;
+            }
+          p++;
+        }
+    }
+  while (depth > 0);
+
+  return p;
+}
+
+void
+json_measure (const char *json, size_t len, unsigned max_depth,
+              size_t max_values, json_shape_t *shape)
+{
+  const char *p = json;
+  const char * const end = json + len;
+  unsigned depth = 0;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  /* The top-level value */
+  shape->depth = 0;
+  shape->values = 1;
+
+  while (p < end)
+    {
+      switch (*p)
+        {
+        case '"':
+          /* Brackets and commas in the strings don't count */
+          if ((p = find_string_end (p, end)) == NULL)
+            return;
+          break;
+        case '{':
+        case '[':
+          /* The first item of the container, which may turn out empty */
+          shape->values++;
+          if (++depth > shape->depth
+              && (shape->depth = depth) > max_depth && max_depth)
+            return;
+          break;
+        case '}':
+        case ']':
+          if (depth > 0)
+            depth--;
+          break;
+        case ',':
+          if (++shape->values > max_values && max_values)
+            return;
+          break;
+        }
+      p++;
+    }
+}
+
+/* Returns a pointer to the value of the `key` member of the top-level object
+   in `json`, or NULL if it is not found */
+static const char *
+find_member (const char *json, size_t json_len, const char *key)
+{
+  const char * const end = json + json_len;
+  const size_t key_len = strlen (key);
+  const char *p = json;
+
+  p = skip_whitespace (p, end);
+  if (p == end || *p != '{')
+    return NULL;
+  p++;
+
+  for (;;)
+    {
+      const char *key_end;
+      bool found;
+
+      p = skip_whitespace (p, end);
+      if (p == end || *p != '"' || (key_end = find_string_end (p, end)) == NULL)
+        return NULL;
+
+      found = (size_t) (key_end - p - 1) == key_len
+              && !memcmp (p + 1, key, key_len);
+
+      p = skip_whitespace (key_end + 1, end);
+      if (p == end || *p != ':')
+        return NULL;
+      p = skip_whitespace (p + 1, end);
+      if (found)
+        return p;
+      if ((p = skip_value (p, end)) == NULL)
+        return NULL;
+      p = skip_whitespace (p, end);
+      if (p == end || *p != ',')
+        return NULL;
+      p++;
+    }
+}
+
+bool
+json_extract_string_member (char *json, size_t json_len, const char *key,
+                            char **value, size_t *value_len)
+{
+  const char * const end = json + json_len;
+  const char *p;
+  const char *value_end;
+  char *out;
+  char *out_end;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  p = find_member (json, json_len, key);
+  if (p == NULL || p == end || *p != '"'
+      || (value_end = find_string_end (p, end)) == NULL)
+    return false;
+
+  /* Unescaping never makes a string longer */
+  out = malloc (value_end - p);
+  if (unlikely (out == NULL))
+    return false;
+  out_end = json_unescape (out, p + 1, value_end - p - 1);
+  if (out_end == NULL)
+    {
+      free (out);
+      return false;
+    }
+  *out_end = '\0';
+
+  /* Leave an empty string in place of the value; whitespace keeps the rest
+     of the document intact */
+  memset ((char *) p + 1, ' ', value_end - p);
+  ((char *) p)[1] = '"';
+
+  *value = out;
+  *value_len = out_end - out;
+  return true;
+}
+
+unsigned
+json_count_array_member (const char *json, size_t json_len, const char *key,
+                         unsigned limit)
+{
+  const char * const end = json + json_len;
+  const char *p;
+  unsigned count = 0;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  p = find_member (json, json_len, key);
+  if (p == NULL || p == end || *p != '[')
+    return 0;
+
+  p = skip_whitespace (p + 1, end);
+  if (p != end && *p == ']')
+    return 0;
+
+  while (count <= limit)
+    {
+      if ((p = skip_value (p, end)) == NULL)
+        break;
+      count++;
+      p = skip_whitespace (p, end);
+      if (p == end || *p != ',')
+        break;
+      p = skip_whitespace (p + 1, end);
+    }
+
+  return count;
+}
+
+/* A part of the text escaped by a single thread */
+typedef struct _json_chunk_t {
+  const char *src;
+  size_t src_len;
+  char *out;
+  size_t out_len;
+  uv_thread_t thread;
+  bool threaded;
+} json_chunk_t;
+
+static void
+measure_chunk (void *arg)
+{
+  json_chunk_t *chunk = arg;
+  chunk->out_len = json_escaped_len (chunk->src, chunk->src_len);
+}
+
+static void
+escape_chunk (void *arg)
+{
+  json_chunk_t *chunk = arg;
+  json_escape (chunk->out, chunk->src, chunk->src_len);
+}
+
+/* Runs `fn` for every chunk. The first chunk is processed by the calling
+   thread; if a thread can't be created, its chunk is processed by the calling
+   thread as well. */
+static void
+run_chunks (json_chunk_t *chunks, unsigned num_chunks, void (*fn) (void *))
+{
+  unsigned i;
+
+  for (i = 1; i < num_chunks; i++)
+    chunks[i].threaded = !uv_thread_create (&chunks[i].thread, fn, &chunks[i]);
+
+  fn (&chunks[0]);
+
+  for (i = 1; i < num_chunks; i++)
+    {
+      if (chunks[i].threaded)
+        uv_thread_join (&chunks[i].thread);
+      else
+        fn (&chunks[i]);
+    }
+}
+
+/* Number of threads set with JSON_THREADS_ENV, or 0 */
+static unsigned forced_threads = 0;
+static uv_once_t forced_threads_once = UV_ONCE_INIT;
+
+static void
+read_forced_threads (void)
+{
+  const char *value = getenv (JSON_THREADS_ENV);
+  unsigned long n;
+  char *end;
+
+  if (value == NULL || *value == '\0')
+    return;
+  n = strtoul (value, &end, 10);
+  if (*end != '\0' || n == 0)
+    {
+      elog_error ("Ignoring invalid %s value: %s\n", JSON_THREADS_ENV, value);
+      return;
+    }
+  forced_threads = n > JSON_MAX_THREADS ? JSON_MAX_THREADS : (unsigned) n;
+}
+
+/* Returns the number of threads to escape `len` bytes with */
+static unsigned
+get_num_threads (size_t len)
+{
+  size_t n;
+
+  uv_once (&forced_threads_once, read_forced_threads);
+  n = forced_threads;
+  if (n > len / JSON_MIN_CHUNK_SIZE)
+    n = len / JSON_MIN_CHUNK_SIZE;
+
+  return n ? (unsigned) n : 1;
+}
+
+char *
+json_make_string_object (const char *key, const char *text, size_t len,
+                         uint32_t *size)
+{
+  json_chunk_t chunks[JSON_MAX_THREADS] = { 0 };
+  unsigned num_chunks = get_num_threads (len);
+  const size_t key_len = strlen (key);
+  size_t text_start = 0;
+  size_t total = 0;
+  size_t offset = 0;
+  char *response = NULL;
+  unsigned i;
+
+  /* Split the text at UTF-8 character boundaries */
+  for (i = 0; i < num_chunks; i++)
+    {
+      size_t end = i + 1 == num_chunks ? len : len / num_chunks * (i + 1);
+
+      while (end > offset && end < len && (text[end] & 0xc0) == 0x80)
+        end--;
+
+      chunks[i].src = text + offset;
+      chunks[i].src_len = end - offset;
+      offset = end;
+    }
+
+  if (num_chunks > 1)
+    {
+      elog_debug ("%s: escaping %zu bytes in %u threads\n", __func__, len,
+                  num_chunks);
+      run_chunks (chunks, num_chunks, measure_chunk);
+    }
+  else
+    measure_chunk (&chunks[0]);
+
+  /* {"key":"text"} */
+  text_start = sizeof ("{\"") - 1 + key_len + sizeof ("\":\"") - 1;
+  total = text_start;
+  for (i = 0; i < num_chunks; i++)
+    total += chunks[i].out_len;
+  total += sizeof ("\"}");
+
+  if (unlikely (total > UINT32_MAX))
+    {
+      elog_error ("Response is too large (%zu bytes)\n", total);
+      return NULL;
+    }
+
+  response = malloc (total);
+  if (unlikely (response == NULL))
+    {
+      elog_error ("Failed to allocate %zu bytes for response\n", total);
+      return NULL;
+    }
+
+  memcpy (response, "{\"", 2);
+  memcpy (response + 2, key, key_len);
+  memcpy (response + 2 + key_len, "\":\"", 3);
+
+  offset = text_start;
+  for (i = 0; i < num_chunks; i++)
+    {
+      chunks[i].out = response + offset;
+      offset += chunks[i].out_len;
+    }
+
+  if (num_chunks > 1)
+    run_chunks (chunks, num_chunks, escape_chunk);
+  else
+    escape_chunk (&chunks[0]);
+
+  memcpy (response + offset, "\"}", sizeof ("\"}"));
+  *size = (uint32_t) total;
+
+  return response;
+}
+
+char *
+json_make_fields_object (const json_field_t *fields, size_t num_fields,
+                         uint32_t *size)
+{
+  static const char head[] = "{\"fields\":[";
+  static const char id_prefix[] = "{\"id\":\"";
+  static const char text_prefix[] = "\",\"text\":\"";
+  static const char item_suffix[] = "\"}";
+  size_t total = sizeof (head) - 1 + sizeof ("]}");
+  char *response = NULL;
+  char *p = NULL;
+  size_t i;
+
+  for (i = 0; i < num_fields; i++)
+    {
+      total += (i ? 1 : 0) /* , */
+        + sizeof (id_prefix) - 1
+        + json_escaped_len (fields[i].id, strlen (fields[i].id))
+        + sizeof (text_prefix) - 1
+        + json_escaped_len (fields[i].text, fields[i].len)
+        + sizeof (item_suffix) - 1;
+    }
+
+  if (unlikely (total > UINT32_MAX))
+    {
+      elog_error ("Response is too large (%zu bytes)\n", total);
+      return NULL;
+    }
+
+  response = malloc (total);
+  if (unlikely (response == NULL))
+    {
+      elog_error ("Failed to allocate %zu bytes for response\n", total);
+      return NULL;
+    }
+
+  p = response;
+  memcpy (p, head, sizeof (head) - 1);
+  p += sizeof (head) - 1;
+  for (i = 0; i < num_fields; i++)
+    {
+      if (i)
+        *p++ = ',';
+      memcpy (p, id_prefix, sizeof (id_prefix) - 1);
+      p += sizeof (id_prefix) - 1;
+      p = json_escape (p, fields[i].id, strlen (fields[i].id));
+      memcpy (p, text_prefix, sizeof (text_prefix) - 1);
+      p += sizeof (text_prefix) - 1;
+      p = json_escape (p, fields[i].text, fields[i].len);
+      memcpy (p, item_suffix, sizeof (item_suffix) - 1);
+      p += sizeof (item_suffix) - 1;
+    }
+  memcpy (p, "]}", sizeof ("]}"));
+
+  *size = (uint32_t) total;
+  return response;
+}
@@ -0,0 +1,125 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * JSON encoding helpers header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_JSON_H__
+#define __BEECTL_JSON_H__
+
+#include <stdbool.h>
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t */
+
+/* Minimum number of input bytes per thread */
+#define JSON_MIN_CHUNK_SIZE (1024 * 1024)
+
+/* Maximum number of threads used for escaping */
+#define JSON_MAX_THREADS 8
+
+/* Environment variable which sets the number of threads used for escaping.
+   Responses are escaped by a single thread unless it is set: the gain of
+   the parallel escaping has not been measured on multi-core machines yet
+   (see escape-bench.py). The number is limited by JSON_MAX_THREADS and
+   JSON_MIN_CHUNK_SIZE. */
+#define JSON_THREADS_ENV "BEECTL_JSON_THREADS"
+
+/* Returns the length of `len` bytes of `s` escaped as a JSON string
+   (without the quotes) */
+size_t json_escaped_len (const char *s, size_t len);
+
+/* Escapes `len` bytes of `s` as a JSON string (without the quotes) into `out`,
+   which must have room for json_escaped_len() bytes.
+   The escaping is the same as in cJSON: '"', '\\' and control characters are
+   escaped; other bytes including non-ASCII are copied as is.
+   Returns a pointer to the byte following the last byte written. */
+char *json_escape (char *out, const char *s, size_t len);
+
+/* Unescapes `len` bytes of the JSON string body `s` (without the quotes) into
+   `out`, which must have room for `len` bytes.
+   Returns a pointer to the byte following the last byte written, or NULL if
+   the string is not valid. */
+char *json_unescape (char *out, const char *s, size_t len);
+
+/* Shape of a JSON document, which bounds the cost of parsing it */
+typedef struct _json_shape_t {
+  /* Maximum nesting depth of the arrays and objects */
+  unsigned depth;
+  /* Upper bound of the number of values, i.e. of the nodes a parser
+     allocates. Array items and object members count once. */
+  size_t values;
+} json_shape_t;
+
+/* Measures the shape of `len` bytes of `json` without parsing it. The scan
+   stops as soon as the depth exceeds `max_depth` or the number of values
+   exceeds `max_values` (0 means no limit), so the cost of rejecting a
+   document is bounded. */
+void json_measure (const char *json, size_t len, unsigned max_depth,
+                   size_t max_values, json_shape_t *shape);
+
+/* Extracts the string value of the `key` member of the top-level object in
+   `json` without parsing the rest of the document. The value is replaced
+   with an empty string in `json`, so that a full parse of the document
+   doesn't unescape it again.
+
+   On success, the unescaped null-terminated value is saved into `value` and
+   its length into `value_len`, and true is returned. The value must be freed
+   by the caller. If the member is not found or can't be extracted, `json` is
+   left intact, and false is returned. */
+bool json_extract_string_member (char *json, size_t json_len, const char *key,
+                                 char **value, size_t *value_len);
+
+/* Returns the number of items of the array which is the value of the `key`
+   member of the top-level object in `json`, without parsing the document.
+   Counting stops after `limit` + 1 items. If the member is not an array, 0
+   is returned. */
+unsigned json_count_array_member (const char *json, size_t json_len,
+                                  const char *key, unsigned limit);
+
+/* Makes a JSON object with a single string member {"key":"text"}.
+   Large texts are escaped in parallel.
+
+   Returns a null-terminated string. The size of the string including the
+   terminating null byte is saved into `size`.
+   On error, NULL is returned. The returned string must be freed by the
+   caller. */
+char *json_make_string_object (const char *key, const char *text, size_t len,
+                               uint32_t *size);
+
+/* An item of the "fields" array made by json_make_fields_object() */
+typedef struct _json_field_t {
+  const char *id;
+  const char *text;
+  size_t len;
+} json_field_t;
+
+/* Makes a JSON object with the array of fields
+   {"fields":[{"id":"...","text":"..."},...]}.
+
+   Returns a null-terminated string. The size of the string including the
+   terminating null byte is saved into `size`.
+   On error, NULL is returned. The returned string must be freed by the
+   caller. */
+char *json_make_fields_object (const json_field_t *fields, size_t num_fields,
+                               uint32_t *size);
+
+#endif /* __BEECTL_JSON_H__ */
@@ -0,0 +1,61 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Static tracepoints (USDT).
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_PROBES_H__
+#define __BEECTL_PROBES_H__
+
+/* Static tracepoints of the "beectl" provider, for bpftrace, perf and
+   SystemTap:
+
+   request_start                 reading of the browser request begins
+   request_done (size)           the request body has been read
+   editor_resolved (path)        the editor executable has been found
+   tmpfile_created (path, size)  the text has been written to a file
+   editor_spawn (pid)            the editor process has been started
+   editor_ready (latency_ns)     the editor has first opened the files
+   file_event (filename, events) raw change event of a watched file
+   debounce_fire                 the debounce timer has expired
+   snapshot_read (path, size)    a file has been read to be sent
+   torn_read (path, size)        the file changed while being read, or shrank
+   encode_done (size)            a response has been encoded
+   frame_written (size)          a response frame has been written
+
+   The probes are compiled in if beectl is configured with -DBEECTL_USDT=ON
+   and sys/sdt.h is available. An inactive probe is a single nop; the
+   arguments should be values already at hand. Sample scripts are in the
+   bpftrace directory. */
+
+#ifdef HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define BEECTL_PROBE0(name) DTRACE_PROBE (beectl, name)
+# define BEECTL_PROBE1(name, a) DTRACE_PROBE1 (beectl, name, a)
+# define BEECTL_PROBE2(name, a, b) DTRACE_PROBE2 (beectl, name, a, b)
+#else
+# define BEECTL_PROBE0(name) do {} while (0)
+# define BEECTL_PROBE1(name, a) do {} while (0)
+# define BEECTL_PROBE2(name, a, b) do {} while (0)
+#endif
+
+#endif /* __BEECTL_PROBES_H__ */
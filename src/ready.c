@@ -0,0 +1,388 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Detection of the editor opening the edited files.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "ready.h"
+#include "common.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h> /* calloc, free */
+#include <string.h> /* strcmp, strerror */
+#include <errno.h>
+#include <limits.h> /* PATH_MAX */
+
+#ifdef __linux__
+# include <dirent.h>      /* opendir readdir closedir */
+# include <unistd.h>      /* read, readlink, close */
+# include <sys/inotify.h>
+#endif
+
+static struct {
+  bool active;
+  uv_loop_t *loop;
+  const field_t *fields;
+  unsigned num_fields;
+  const char *dir;
+  int pid;
+  uint64_t start_time;
+  ready_cb_t cb;
+  void *arg;
+#ifdef __linux__
+  int inotify_fd;
+  /* Watch descriptor of `dir`, or -1 */
+  int dir_wd;
+  uv_poll_t poll;
+#endif
+  /* Access times of the files when last rebased */
+  uv_timespec_t *atimes;
+  uv_timer_t timer;
+  bool timer_started;
+} ready = { 0 };
+
+/* Gets the access time of a file */
+static bool
+get_atime (const char *path, uv_timespec_t *atime)
+{
+  uv_fs_t req;
+  int res = uv_fs_stat (ready.loop, &req, path, NULL);
+
+  if (res == 0)
+    *atime = req.statbuf.st_atim;
+  uv_fs_req_cleanup (&req);
+  return res == 0;
+}
+
+static void
+read_atimes (void)
+{
+  for (unsigned i = 0; i < ready.num_fields; i++)
+    if (!get_atime (ready.fields[i].path, &ready.atimes[i]))
+      memset (&ready.atimes[i], 0, sizeof (ready.atimes[i]));
+}
+
+/* Returns true if the access time of a file has changed. Reading the file
+   updates it, unless the file system is mounted with noatime. */
+static bool
+atime_changed (void)
+{
+  uv_timespec_t atime;
+
+  for (unsigned i = 0; i < ready.num_fields; i++)
+    if (get_atime (ready.fields[i].path, &atime)
+        && (atime.tv_sec != ready.atimes[i].tv_sec
+            || atime.tv_nsec != ready.atimes[i].tv_nsec))
+      return true;
+  return false;
+}
+
+/* Returns true if the editor has one of the files open */
+static bool
+editor_has_file_open (void)
+{
+#ifdef __linux__
+  char dir_path[64];
+  char link_path[64 + 256];
+  char target[PATH_MAX];
+  DIR *dir;
+  struct dirent *entry;
+  bool found = false;
+
+  if (ready.pid <= 0)
+    return false;
+  snprintf (dir_path, sizeof (dir_path), "/proc/%d/fd", ready.pid);
+  if ((dir = opendir (dir_path)) == NULL)
+    return false;
+  while (!found && (entry = readdir (dir)) != NULL)
+    {
+      ssize_t n;
+
+      if (entry->d_name[0] == '.')
+        continue;
+      snprintf (link_path, sizeof (link_path), "%s/%s", dir_path,
+                entry->d_name);
+      n = readlink (link_path, target, sizeof (target) - 1);
+      if (n <= 0)
+        continue;
+      target[n] = '\0';
+      found = ready.dir != NULL && strcmp (target, ready.dir) == 0;
+      for (unsigned i = 0; !found && i < ready.num_fields; i++)
+        found = strcmp (target, ready.fields[i].path) == 0;
+    }
+  closedir (dir);
+  return found;
+#else
+  return false;
+#endif
+}
+
+#ifdef __linux__
+/* Reads the pending inotify events. Returns true if one of them is an
+   access to the files or to the directory itself. */
+static bool
+read_inotify_events (void)
+{
+  union {
+    struct inotify_event event;
+    char buf[4096];
+  } u;
+  bool found = false;
+  ssize_t n;
+
+  while ((n = read (ready.inotify_fd, u.buf, sizeof (u.buf))) > 0)
+    {
+      for (char *p = u.buf; p < u.buf + n;)
+        {
+          const struct inotify_event *event = (const struct inotify_event *) p;
+
+          /* The directory watch also reports the entries of the directory,
+             such as the lock file of a cache entry */
+          if (event->wd != ready.dir_wd || event->len == 0)
+            found = true;
+          p += sizeof (struct inotify_event) + event->len;
+        }
+    }
+  return found;
+}
+#endif
+
+static void
+close_handles (void)
+{
+#ifdef __linux__
+  if (ready.inotify_fd != -1)
+    {
+      uv_poll_stop (&ready.poll);
+      uv_close ((uv_handle_t *) &ready.poll, NULL);
+      close (ready.inotify_fd);
+      ready.inotify_fd = -1;
+    }
+#endif
+  if (ready.timer_started)
+    {
+      uv_timer_stop (&ready.timer);
+      uv_close ((uv_handle_t *) &ready.timer, NULL);
+      ready.timer_started = false;
+    }
+  free (ready.atimes);
+  ready.atimes = NULL;
+}
+
+static void
+set_ready (void)
+{
+  const uint64_t latency_ns = uv_hrtime () - ready.start_time;
+
+  ready.active = false;
+  close_handles ();
+  ready.cb (latency_ns, ready.arg);
+}
+
+/* Checks for the editor, and calls the callback if it is ready */
+static void
+check_ready (void)
+{
+  bool found;
+
+#ifdef __linux__
+  if (ready.inotify_fd != -1)
+    found = read_inotify_events ();
+  else
+#endif
+    found = atime_changed () || editor_has_file_open ();
+
+  if (found)
+    set_ready ();
+}
+
+#ifdef __linux__
+static void
+on_inotify_readable (uv_poll_t *handle, int status, int events)
+{
+  if (status < 0)
+    {
+      elog_error ("inotify poll error: %s\n", uv_strerror (status));
+      return;
+    }
+  check_ready ();
+}
+
+/* Watches the files with inotify. Returns false if it isn't possible. */
+static bool
+start_inotify (void)
+{
+  const uint32_t mask = IN_OPEN | IN_ACCESS;
+  int res;
+
+  ready.inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (ready.inotify_fd == -1)
+    {
+      elog_debug ("%s: inotify_init1: %s\n", __func__, strerror (errno));
+      return false;
+    }
+
+  for (unsigned i = 0; i < ready.num_fields; i++)
+    if (inotify_add_watch (ready.inotify_fd, ready.fields[i].path, mask)
+        == -1)
+      {
+        elog_debug ("%s: inotify_add_watch %s: %s\n", __func__,
+                    ready.fields[i].path, strerror (errno));
+        goto _err;
+      }
+  if (ready.dir != NULL
+      && (ready.dir_wd = inotify_add_watch (ready.inotify_fd, ready.dir,
+                                            mask | IN_ONLYDIR)) == -1)
+    {
+      elog_debug ("%s: inotify_add_watch %s: %s\n", __func__, ready.dir,
+                  strerror (errno));
+      goto _err;
+    }
+
+  res = uv_poll_init (ready.loop, &ready.poll, ready.inotify_fd);
+  if (res == 0)
+    res = uv_poll_start (&ready.poll, UV_READABLE, on_inotify_readable);
+  if (res < 0)
+    {
+      elog_error ("Failed to poll inotify: %s\n", uv_strerror (res));
+      uv_close ((uv_handle_t *) &ready.poll, NULL);
+      goto _err;
+    }
+  /* The detection must not keep the loop alive */
+  uv_unref ((uv_handle_t *) &ready.poll);
+  return true;
+
+_err:
+  close (ready.inotify_fd);
+  ready.inotify_fd = -1;
+  return false;
+}
+#endif
+
+static void
+on_sample (uv_timer_t *timer)
+{
+  check_ready ();
+
+  /* Stating every file every few milliseconds only pays off while the
+     editor is starting */
+  if (ready.active && uv_timer_get_repeat (timer) == READY_SAMPLE_MS
+      && uv_hrtime () - ready.start_time
+         >= (uint64_t) READY_STARTUP_WINDOW_MS * 1000000)
+    uv_timer_set_repeat (timer, READY_SLOW_SAMPLE_MS);
+}
+
+bool
+ready_start (uv_loop_t *loop, const field_t *fields, unsigned num_fields,
+             const char *dir, ready_cb_t cb, void *arg)
+{
+  int res;
+
+  if (ready.active)
+    return false;
+
+  ready.loop = loop;
+  ready.fields = fields;
+  ready.num_fields = num_fields;
+  ready.dir = dir;
+  ready.pid = 0;
+  ready.cb = cb;
+  ready.arg = arg;
+  ready.start_time = uv_hrtime ();
+  ready.timer_started = false;
+
+  ready.atimes = calloc (num_fields, sizeof (*ready.atimes));
+  if (ready.atimes == NULL)
+    {
+      perror ("calloc");
+      return false;
+    }
+
+#ifdef __linux__
+  ready.dir_wd = -1;
+  if (start_inotify ())
+    {
+      ready.active = true;
+      return true;
+    }
+#endif
+
+  /* The files have been written, but not read yet */
+  read_atimes ();
+  uv_timer_init (loop, &ready.timer);
+  res = uv_timer_start (&ready.timer, on_sample, 0, READY_SAMPLE_MS);
+  if (res < 0)
+    {
+      elog_error ("Failed to start ready timer: %s\n", uv_strerror (res));
+      uv_close ((uv_handle_t *) &ready.timer, NULL);
+      free (ready.atimes);
+      ready.atimes = NULL;
+      return false;
+    }
+  uv_unref ((uv_handle_t *) &ready.timer);
+  ready.timer_started = true;
+  ready.active = true;
+  return true;
+}
+
+void
+ready_set_pid (int pid)
+{
+  ready.pid = pid;
+}
+
+void
+ready_touched (void)
+{
+  if (ready.active)
+    set_ready ();
+}
+
+void
+ready_rebase (void)
+{
+  if (!ready.active)
+    return;
+#ifdef __linux__
+  if (ready.inotify_fd != -1)
+    {
+      /* The events of the host's accesses have been queued by now */
+      read_inotify_events ();
+      return;
+    }
+#endif
+  read_atimes ();
+}
+
+void
+ready_stop (void)
+{
+  if (!ready.active)
+    return;
+  check_ready ();
+  if (ready.active)
+    {
+      ready.active = false;
+      close_handles ();
+    }
+}
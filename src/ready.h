@@ -0,0 +1,88 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Detection of the editor opening the edited files.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_READY_H__
+#define __BEECTL_READY_H__
+
+#include "io.h" /* field_t */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <uv.h>
+
+/* Detects when the spawned editor is ready, i.e. when it first opens or
+   reads one of the edited files.
+
+   On Linux, the files are watched with inotify for IN_OPEN and IN_ACCESS.
+   Elsewhere, or if inotify can't be used, the files are sampled every
+   READY_SAMPLE_MS milliseconds during the first READY_STARTUP_WINDOW_MS,
+   then every READY_SLOW_SAMPLE_MS: a changed access time, or the file found
+   among the open descriptors of the editor, means it is ready. Either way, a
+   change of a file means the editor has opened it (ready_touched()).
+
+   The host's own accesses to the files after ready_start() must be
+   followed by ready_rebase(), or they are taken for the editor's. */
+
+/* Interval of the sampling if inotify is not available; it bounds the error
+   of the latency */
+#define READY_SAMPLE_MS 10
+
+/* Time since ready_start() after which an editor which is still not ready
+   is sampled every READY_SLOW_SAMPLE_MS */
+#define READY_STARTUP_WINDOW_MS 2000
+#define READY_SLOW_SAMPLE_MS 500
+
+/* Called once the editor is ready, with the time since ready_start() */
+typedef void (*ready_cb_t) (uint64_t latency_ns, void *arg);
+
+/* Starts watching the files of `fields` for the editor which is about to be
+   spawned. It must be called right before the spawn, so that an editor
+   which opens the files at once is not missed. If `dir` is not NULL,
+   opening the directory also counts (the editor was given the directory).
+   The fields must outlive the detection.
+
+   Returns false if neither of the methods could be started. */
+bool ready_start (uv_loop_t *loop, const field_t *fields, unsigned num_fields,
+                  const char *dir, ready_cb_t cb, void *arg);
+
+/* Sets the process ID of the editor once it has been spawned. Until then,
+   its open descriptors are not sampled. */
+void ready_set_pid (int pid);
+
+/* Records that the editor has changed a file. Must be called before the
+   host reads the file. */
+void ready_touched (void);
+
+/* Discards the accesses of the host to the files, e.g. after it has written
+   an update from the browser */
+void ready_rebase (void);
+
+/* Checks for the editor once more, and stops the detection. Should be called
+   when the editor exits, as a short-lived editor may exit before the first
+   sample. */
+void ready_stop (void);
+
+#endif /* __BEECTL_READY_H__ */
@@ -0,0 +1,68 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * SIMD support.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "simd.h"
+#include "io.h" /* elog_* */
+
+#include <stdlib.h> /* getenv */
+#include <string.h> /* strcmp */
+
+#include <uv.h>
+
+static simd_level_t simd_level = SIMD_SCALAR;
+static uv_once_t simd_level_once = UV_ONCE_INIT;
+
+static void
+detect_simd_level (void)
+{
+  const char *limit = getenv ("BEECTL_SIMD");
+
+  if (limit != NULL && !strcmp (limit, "scalar"))
+    goto _ret;
+
+#if defined(SIMD_X86)
+# if defined(__GNUC__) || defined(__clang__)
+  __builtin_cpu_init ();
+  if (!__builtin_cpu_supports ("sse2"))
+    goto _ret;
+# endif
+  simd_level = SIMD_SSE2;
+
+# ifdef SIMD_HAVE_AVX2
+  if ((limit == NULL || strcmp (limit, "sse2")) && __builtin_cpu_supports ("avx2"))
+    simd_level = SIMD_AVX2;
+# endif
+#endif
+
+_ret:
+  elog_debug ("%s: simd_level = %d\n", __func__, simd_level);
+}
+
+simd_level_t
+simd_get_level (void)
+{
+  uv_once (&simd_level_once, detect_simd_level);
+  return simd_level;
+}
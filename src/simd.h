@@ -0,0 +1,69 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * SIMD support header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_SIMD_H__
+#define __BEECTL_SIMD_H__
+#include "common.h" /* forceinline */
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+# define SIMD_X86
+# include <immintrin.h>
+# if defined(__GNUC__) || defined(__clang__)
+/* Compiles a function for the given instruction set regardless of the
+   target of the rest of the file */
+#  define SIMD_TARGET(isa) __attribute__ ((__target__ (isa)))
+#  define SIMD_HAVE_AVX2
+# else
+/* MSVC: SSE2 is the x64 baseline; AVX2 is not dispatched */
+#  define SIMD_TARGET(isa)
+# endif
+#endif
+
+/* Instruction sets the vector kernels are selected from */
+typedef enum _simd_level_t {
+  SIMD_SCALAR = 0,
+  SIMD_SSE2,
+  SIMD_AVX2,
+} simd_level_t;
+
+/* Returns the best instruction set supported by the CPU.
+
+   The BEECTL_SIMD environment variable ("scalar", "sse2" or "avx2") limits
+   the instruction set, e.g. for comparing the kernels. */
+simd_level_t simd_get_level (void);
+
+forceinline unsigned
+count_trailing_zeros (unsigned mask)
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward (&index, mask);
+  return (unsigned) index;
+#else
+  return (unsigned) __builtin_ctz (mask);
+#endif
+}
+
+#endif /* __BEECTL_SIMD_H__ */
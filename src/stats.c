@@ -0,0 +1,275 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Session statistics for soak testing.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "stats.h"
+#include "common.h"
+#include "io.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h> /* getenv, free */
+#include <string.h> /* strerror */
+#include <errno.h>
+#include <inttypes.h>
+
+#ifndef WINDOWS
+# include <dirent.h>       /* opendir readdir closedir */
+# include <sys/resource.h> /* getrusage */
+#endif
+
+/* Each sample is a line of JSON:
+
+   {"pid":N,"event":"response","t_ms":N,"responses":N,"latency_ms":N,
+    "rss_kb":N,"fds":N,"handles":N,"torn_reads":N}
+
+   t_ms is the time since stats_init(). fds and rss_kb are -1 if they can't
+   be determined on this platform. handles is the number of libuv handles
+   which are not being closed. torn_reads is the number of reads discarded
+   so far because the file was being written.
+
+   When the editor exits, a sample of its telemetry is written:
+
+   {"pid":N,"event":"editor","t_ms":N,"editor":"vim","exit_status":N,
+    "term_signal":N,"startup_ms":N,"wall_ms":N,"user_ms":N,"sys_ms":N,
+    "maxrss_kb":N}
+
+   "editor" is the base name of the editor executable. startup_ms is the
+   time from the spawn until the editor was ready (see ready.h), or -1 if
+   that wasn't seen. The CPU times and the peak RSS cover the editor and the
+   descendants it waited for; they are -1 where getrusage() isn't
+   available. Editors which hand the file over to a running instance
+   show up with a short wall time and the startup of the client only. */
+
+static FILE *stats_fp = NULL;
+static uv_loop_t *stats_loop = NULL;
+static uint64_t start_time = 0;
+static uint64_t num_responses = 0;
+
+/* The running editor */
+static struct {
+  bool running;
+  char *name;
+  uint64_t spawn_time;
+  /* Time from the spawn until the editor was ready, or 0 */
+  uint64_t ready_ns;
+} editor_stats = { 0 };
+
+static void
+count_handle (uv_handle_t *handle, void *arg)
+{
+  if (!uv_is_closing (handle))
+    (*(long *) arg)++;
+}
+
+static long
+count_handles (void)
+{
+  long n = 0;
+
+  if (stats_loop != NULL)
+    uv_walk (stats_loop, count_handle, &n);
+  return n;
+}
+
+/* Returns the number of open file descriptors, or -1 */
+static long
+count_fds (void)
+{
+#ifdef WINDOWS
+  return -1;
+#else
+  DIR *dir;
+  struct dirent *entry;
+  long n = 0;
+
+  /* /dev/fd on macOS and FreeBSD */
+  if ((dir = opendir ("/proc/self/fd")) == NULL
+      && (dir = opendir ("/dev/fd")) == NULL)
+    return -1;
+
+  while ((entry = readdir (dir)) != NULL)
+    if (entry->d_name[0] != '.')
+      n++;
+  closedir (dir);
+
+  /* Excluding the descriptor of the directory being read */
+  return n - 1;
+#endif
+}
+
+static void
+write_sample (const char *event, uint64_t latency_ns)
+{
+  size_t rss = 0;
+  long rss_kb = -1;
+
+  if (uv_resident_set_memory (&rss) == 0)
+    rss_kb = (long) (rss / 1024);
+
+  fprintf (stats_fp,
+           "{\"pid\":%d,\"event\":\"%s\",\"t_ms\":%" PRIu64
+           ",\"responses\":%" PRIu64 ",\"latency_ms\":%.3f"
+           ",\"rss_kb\":%ld,\"fds\":%ld,\"handles\":%ld"
+           ",\"torn_reads\":%" PRIu64 "}\n",
+           (int) uv_os_getpid (), event,
+           (uv_hrtime () - start_time) / 1000000, num_responses,
+           latency_ns / 1e6, rss_kb, count_fds (), count_handles (),
+           get_num_torn_reads ());
+  /* Samples must survive a killed session */
+  fflush (stats_fp);
+}
+
+void
+stats_init (uv_loop_t *loop)
+{
+  const char *path = getenv (STATS_ENV);
+
+  if (path == NULL || *path == '\0' || stats_fp != NULL)
+    return;
+
+  /* Several sessions may append to the same file */
+  stats_fp = fopen (path, "a");
+  if (stats_fp == NULL)
+    {
+      elog_error ("Failed to open stats file %s: %s\n", path, strerror (errno));
+      return;
+    }
+  stats_loop = loop;
+  start_time = uv_hrtime ();
+  write_sample ("start", 0);
+}
+
+void
+stats_response (uint64_t latency_ns)
+{
+  if (stats_fp == NULL)
+    return;
+  num_responses++;
+  write_sample ("response", latency_ns);
+}
+
+bool
+stats_enabled (void)
+{
+  return stats_fp != NULL;
+}
+
+void
+stats_editor_start (const char *editor)
+{
+  const char *name;
+
+  if (stats_fp == NULL || editor_stats.running)
+    return;
+
+  name = strrchr (editor, DIR_SEPARATOR);
+  editor_stats.name = strdup (name != NULL ? name + 1 : editor);
+  if (editor_stats.name == NULL)
+    {
+      perror ("strdup");
+      return;
+    }
+  editor_stats.spawn_time = uv_hrtime ();
+  editor_stats.ready_ns = 0;
+  editor_stats.running = true;
+}
+
+void
+stats_editor_ready (uint64_t latency_ns)
+{
+  if (editor_stats.running && editor_stats.ready_ns == 0)
+    editor_stats.ready_ns = latency_ns;
+}
+
+void
+stats_editor_exit (int64_t exit_status, int term_signal)
+{
+  const uint64_t now = uv_hrtime ();
+  long user_ms = -1;
+  long sys_ms = -1;
+  long maxrss_kb = -1;
+
+  if (stats_fp == NULL || !editor_stats.running)
+    return;
+  editor_stats.running = false;
+
+#ifndef WINDOWS
+  {
+    struct rusage usage;
+
+    /* The editor is the only child process of the session, and libuv has
+       already waited for it */
+    if (getrusage (RUSAGE_CHILDREN, &usage) == 0)
+      {
+        user_ms = usage.ru_utime.tv_sec * 1000L
+                  + usage.ru_utime.tv_usec / 1000;
+        sys_ms = usage.ru_stime.tv_sec * 1000L
+                 + usage.ru_stime.tv_usec / 1000;
+# ifdef __APPLE__
+        maxrss_kb = usage.ru_maxrss / 1024; /* bytes */
+# else
+        maxrss_kb = usage.ru_maxrss;
+# endif
+      }
+  }
+#endif
+
+  fprintf (stats_fp,
+           "{\"pid\":%d,\"event\":\"editor\",\"t_ms\":%" PRIu64
+           ",\"editor\":\"",
+           (int) uv_os_getpid (), (now - start_time) / 1000000);
+  /* The name of the executable may need escaping */
+  for (const char *p = editor_stats.name; *p; p++)
+    {
+      if (*p == '"' || *p == '\\')
+        fprintf (stats_fp, "\\%c", *p);
+      else if ((unsigned char) *p < 0x20)
+        fprintf (stats_fp, "\\u%04x", *p);
+      else
+        fputc (*p, stats_fp);
+    }
+  fprintf (stats_fp,
+           "\",\"exit_status\":%" PRId64 ",\"term_signal\":%d"
+           ",\"startup_ms\":%.3f,\"wall_ms\":%.3f,\"user_ms\":%ld"
+           ",\"sys_ms\":%ld,\"maxrss_kb\":%ld}\n",
+           exit_status, term_signal,
+           editor_stats.ready_ns != 0 ? editor_stats.ready_ns / 1e6 : -1.0,
+           (now - editor_stats.spawn_time) / 1e6, user_ms, sys_ms, maxrss_kb);
+  fflush (stats_fp);
+
+  free (editor_stats.name);
+  editor_stats.name = NULL;
+}
+
+void
+stats_finish (void)
+{
+  if (stats_fp == NULL)
+    return;
+  write_sample ("exit", 0);
+  fclose (stats_fp);
+  stats_fp = NULL;
+  stats_loop = NULL;
+}
@@ -0,0 +1,66 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Session statistics header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_STATS_H__
+#define __BEECTL_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h> /* uint64_t */
+
+#include <uv.h>
+
+/* Path of the file the statistics are appended to. Unless it is set, the
+   stats_* functions do nothing. */
+#define STATS_ENV "BEECTL_STATS"
+
+/* Opens the statistics file named by the STATS_ENV environment variable and
+   writes the "start" sample. The handles of `loop` are counted in every
+   sample. */
+void stats_init (uv_loop_t *loop);
+
+/* Writes a sample after a response has been sent to the browser.
+   `latency_ns` is the time since the file event which caused it, or 0. */
+void stats_response (uint64_t latency_ns);
+
+/* Returns true if the statistics are being collected */
+bool stats_enabled (void);
+
+/* Starts collecting the telemetry of the editor process spawned from
+   `editor` right now */
+void stats_editor_start (const char *editor);
+
+/* Records the time from the spawn until the editor was ready */
+void stats_editor_ready (uint64_t latency_ns);
+
+/* Writes the "editor" sample with the telemetry of the editor, which has
+   exited */
+void stats_editor_exit (int64_t exit_status, int term_signal);
+
+/* Writes the "exit" sample and closes the statistics file. Should be called
+   after the session resources have been released, so that leaks show up in
+   the sample. */
+void stats_finish (void);
+
+#endif /* __BEECTL_STATS_H__ */
@@ -69,6 +69,199 @@ ends_with (const char *str, const char *suffix)
                   suffix, suffix_len);
 }
 
+
+/* XXH64 primes */
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3 0x165667B19E3779F9ULL
+#define HASH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define HASH_PRIME5 0x27D4EB2F165667C5ULL
+
+static forceinline uint64_t
+hash_rotl (uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static forceinline uint64_t
+hash_read64 (const unsigned char *p)
+{
+  uint64_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static forceinline uint32_t
+hash_read32 (const unsigned char *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static forceinline uint64_t
+hash_round (uint64_t acc, uint64_t input)
+{
+  acc += input * HASH_PRIME2;
+  acc = hash_rotl (acc, 31);
+  return acc * HASH_PRIME1;
+}
+
+static forceinline uint64_t
+hash_merge_round (uint64_t acc, uint64_t val)
+{
+  acc ^= hash_round (0, val);
+  return acc * HASH_PRIME1 + HASH_PRIME4;
+}
+
+/* Merges the four accumulators of the 32-byte stripes */
+static forceinline uint64_t
+hash_merge_lanes (const uint64_t v[4])
+{
+  uint64_t h = hash_rotl (v[0], 1) + hash_rotl (v[1], 7)
+               + hash_rotl (v[2], 12) + hash_rotl (v[3], 18);
+
+  h = hash_merge_round (h, v[0]);
+  h = hash_merge_round (h, v[1]);
+  h = hash_merge_round (h, v[2]);
+  h = hash_merge_round (h, v[3]);
+  return h;
+}
+
+/* Consumes the last bytes, fewer than a stripe, and mixes the result */
+static forceinline uint64_t
+hash_finish (uint64_t h, const unsigned char *p, const unsigned char *end)
+{
+  for (; p + 8 <= end; p += 8)
+    {
+      h ^= hash_round (0, hash_read64 (p));
+      h = hash_rotl (h, 27) * HASH_PRIME1 + HASH_PRIME4;
+    }
+  if (p + 4 <= end)
+    {
+      h ^= (uint64_t) hash_read32 (p) * HASH_PRIME1;
+      h = hash_rotl (h, 23) * HASH_PRIME2 + HASH_PRIME3;
+      p += 4;
+    }
+  for (; p < end; p++)
+    {
+      h ^= (*p) * HASH_PRIME5;
+      h = hash_rotl (h, 11) * HASH_PRIME1;
+    }
+
+  h ^= h >> 33;
+  h *= HASH_PRIME2;
+  h ^= h >> 29;
+  h *= HASH_PRIME3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+/* XXH64 with seed 0. The values are only compared within a single process,
+   so the byte order of the platform doesn't matter. */
+uint64_t
+str_hash (const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  const unsigned char * const end = p + len;
+  uint64_t h;
+
+  if (len >= 32)
+    {
+      const unsigned char * const limit = end - 32;
+      uint64_t v[4] = {
+        HASH_PRIME1 + HASH_PRIME2, HASH_PRIME2, 0, -HASH_PRIME1
+      };
+
+      do
+        {
+          v[0] = hash_round (v[0], hash_read64 (p));
+          v[1] = hash_round (v[1], hash_read64 (p + 8));
+          v[2] = hash_round (v[2], hash_read64 (p + 16));
+          v[3] = hash_round (v[3], hash_read64 (p + 24));
+          p += 32;
+        }
+      while (p <= limit);
+
+      h = hash_merge_lanes (v);
+    }
+  else
+    h = HASH_PRIME5;
+
+  h += (uint64_t) len;
+
+  return hash_finish (h, p, end);
+}
+
+void
+str_hash_init (str_hash_state_t *state)
+{
+  memset (state, 0, sizeof (*state));
+  state->v[0] = HASH_PRIME1 + HASH_PRIME2;
+  state->v[1] = HASH_PRIME2;
+  state->v[2] = 0;
+  state->v[3] = -HASH_PRIME1;
+}
+
+/* Consumes a 32-byte stripe */
+static forceinline void
+hash_stripe (uint64_t v[4], const unsigned char *p)
+{
+  v[0] = hash_round (v[0], hash_read64 (p));
+  v[1] = hash_round (v[1], hash_read64 (p + 8));
+  v[2] = hash_round (v[2], hash_read64 (p + 16));
+  v[3] = hash_round (v[3], hash_read64 (p + 24));
+}
+
+void
+str_hash_update (str_hash_state_t *state, const void *data, size_t len)
+{
+  const unsigned char *p = data;
+  const unsigned char * const end = p + len;
+
+  state->total_len += len;
+
+  /* Complete the buffered stripe */
+  if (state->buf_len + len < sizeof (state->buf))
+    {
+      memcpy (state->buf + state->buf_len, p, len);
+      state->buf_len += (unsigned) len;
+      return;
+    }
+  if (state->buf_len)
+    {
+      size_t n = sizeof (state->buf) - state->buf_len;
+
+      memcpy (state->buf + state->buf_len, p, n);
+      hash_stripe (state->v, state->buf);
+      p += n;
+      state->buf_len = 0;
+    }
+
+  for (; p + 32 <= end; p += 32)
+    hash_stripe (state->v, p);
+
+  memcpy (state->buf, p, (size_t) (end - p));
+  state->buf_len = (unsigned) (end - p);
+}
+
+uint64_t
+str_hash_digest (const str_hash_state_t *state)
+{
+  uint64_t h;
+
+  if (state->total_len >= 32)
+    h = hash_merge_lanes (state->v);
+  else
+    h = HASH_PRIME5;
+
+  h += state->total_len;
+
+  return hash_finish (h, state->buf, state->buf + state->buf_len);
+}
+
+
 #ifdef WINDOWS
 wchar_t *
 convert_char_array_to_LPCWSTR (const char *str, int *wstr_len_in_chars)
@@ -27,6 +27,7 @@
 #define __BEECTL_STR_H__
 #include "common.h" /* unlikely */
 #include <stdbool.h>
+#include <stdint.h>    /* uint64_t */
 #include <stdlib.h>    /* free */
 #include <string.h>    /* memchr, memcpy */
 #include <sys/types.h> /* size_t */
@@ -38,6 +39,26 @@ char *strndup (const char *s, size_t n);
 /* Checks if a string ends with a suffix */
 bool ends_with (const char *str, const char *suffix);
 
+/* Computes a fast non-cryptographic 64-bit hash of a byte array */
+uint64_t str_hash (const void *data, size_t len);
+
+/* State of a str_hash() computed over data arriving in pieces */
+typedef struct _str_hash_state_t {
+  uint64_t v[4];
+  uint64_t total_len;
+  unsigned char buf[32];
+  unsigned buf_len;
+} str_hash_state_t;
+
+void str_hash_init (str_hash_state_t *state);
+
+/* Hashes the next `len` bytes */
+void str_hash_update (str_hash_state_t *state, const void *data, size_t len);
+
+/* Returns str_hash() of all the bytes passed to str_hash_update() so far.
+   The state can be updated further. */
+uint64_t str_hash_digest (const str_hash_state_t *state);
+
 forceinline const char *
 path_basename (const char *path)
 {
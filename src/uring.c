@@ -0,0 +1,542 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * io_uring backend for Linux.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "uring.h"
+#include "common.h"
+#include "io.h" /* elog_* */
+
+#include <errno.h>
+#include <fcntl.h>  /* AT_FDCWD O_RDONLY */
+#include <stdlib.h> /* malloc realloc free getenv */
+#include <string.h> /* memset */
+#include <sys/mman.h>
+#include <sys/stat.h> /* struct stat */
+#include <sys/sysmacros.h> /* makedev */
+#include <linux/stat.h> /* struct statx */
+#include <sys/syscall.h>
+#include <sys/uio.h> /* struct iovec */
+
+#include <linux/io_uring.h>
+
+/* Number of submission queue entries. A snapshot read takes 5. */
+#define URING_ENTRIES 8
+
+/* Slot in the registered file table used for the file being read */
+#define URING_FILE_SLOT 0
+
+/* Maximum number of read attempts when the file grows while being read */
+#define URING_MAX_READ_ATTEMPTS 3
+
+/* Extra room in the read buffer in case the file has grown since statx */
+#define URING_READ_SLACK 4096
+
+typedef struct _uring_t {
+  int fd;
+  /* Submission queue */
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned *sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  /* Completion queue */
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned *cq_mask;
+  struct io_uring_cqe *cqes;
+  /* Mappings */
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+} uring_t;
+
+static uring_t ring = { .fd = -1 };
+
+static int
+sys_io_uring_setup (unsigned entries, struct io_uring_params *params)
+{
+  return (int) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int
+sys_io_uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+                    unsigned flags)
+{
+  return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int
+sys_io_uring_register (int fd, unsigned opcode, const void *arg,
+                       unsigned nr_args)
+{
+  return (int) syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Checks that the kernel supports all the operations we use. `new_ops` is
+   set if it supports the operations of Linux 5.15, which also brought the
+   direct descriptors. */
+static bool
+probe_ops (bool *new_ops)
+{
+  static const unsigned char ops[] = {
+    IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE,
+    IORING_OP_WRITEV,
+  };
+  const size_t probe_size = sizeof (struct io_uring_probe)
+    + IORING_OP_LAST * sizeof (struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc (1, probe_size);
+  bool ok = probe != NULL;
+  size_t i;
+
+  if (!ok)
+    return false;
+
+  if (sys_io_uring_register (ring.fd, IORING_REGISTER_PROBE, probe,
+                             IORING_OP_LAST) < 0)
+    ok = false;
+
+  for (i = 0; ok && i < sizeof (ops); i++)
+    {
+      if (ops[i] > probe->last_op
+          || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+        ok = false;
+    }
+  *new_ops = ok && IORING_OP_MKDIRAT <= probe->last_op
+             && (probe->ops[IORING_OP_MKDIRAT].flags & IO_URING_OP_SUPPORTED);
+
+  free (probe);
+  return ok;
+}
+
+static struct io_uring_sqe *get_sqe (unsigned *tail);
+static bool submit_and_wait (unsigned tail, int *res, unsigned num);
+
+/* Opens the root directory into the file slot and closes it. The opcodes
+   alone don't tell whether the kernel supports the direct descriptors used
+   by uring_read_file(). Only called on kernels which have them in
+   principle: older ones ignore the slot of the close and would close
+   descriptor 0. */
+static bool
+probe_direct_open (void)
+{
+  int res[1] = { -1 };
+  unsigned tail = *ring.sq_tail;
+  struct io_uring_sqe *sqe;
+
+  sqe = get_sqe (&tail);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uintptr_t) "/";
+  sqe->open_flags = O_RDONLY;
+  sqe->file_index = URING_FILE_SLOT + 1;
+  sqe->user_data = 0;
+
+  if (!submit_and_wait (tail, res, 1) || res[0] != 0)
+    {
+      /* A plain descriptor, if the slot was ignored */
+      if (res[0] > 0)
+        close (res[0]);
+      return false;
+    }
+
+  tail = *ring.sq_tail;
+  sqe = get_sqe (&tail);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = URING_FILE_SLOT + 1;
+  sqe->user_data = 0;
+
+  return submit_and_wait (tail, res, 1) && res[0] == 0;
+}
+
+bool
+uring_init (void)
+{
+  struct io_uring_params params;
+  const char *env = getenv ("BEECTL_IO_URING");
+  int files[1] = { -1 };
+  bool new_ops = false;
+
+  if (ring.fd != -1)
+    return true;
+
+  /* Opt-in: for the typical small files, the plain syscalls are faster, as
+     io_uring punts open and statx to its worker threads */
+  if (env == NULL || strcmp (env, "1"))
+    return false;
+
+  memset (&params, 0, sizeof (params));
+  ring.fd = sys_io_uring_setup (URING_ENTRIES, &params);
+  if (ring.fd < 0)
+    {
+      elog_debug ("%s: io_uring_setup failed: %s\n", __func__,
+                  strerror (errno));
+      ring.fd = -1;
+      return false;
+    }
+
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)
+      || !(params.features & IORING_FEAT_NODROP))
+    {
+      elog_debug ("%s: the kernel is too old\n", __func__);
+      goto _err;
+    }
+
+  ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof (unsigned);
+  ring.cq_ring_size = params.cq_off.cqes
+    + params.cq_entries * sizeof (struct io_uring_cqe);
+  if (ring.cq_ring_size > ring.sq_ring_size)
+    ring.sq_ring_size = ring.cq_ring_size;
+  ring.cq_ring_size = ring.sq_ring_size;
+
+  ring.sq_ring = mmap (NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+  if (ring.sq_ring == MAP_FAILED)
+    {
+      ring.sq_ring = NULL;
+      goto _err;
+    }
+  ring.cq_ring = ring.sq_ring;
+
+  ring.sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+  ring.sqes = mmap (NULL, ring.sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+  if (ring.sqes == MAP_FAILED)
+    {
+      ring.sqes = NULL;
+      goto _err;
+    }
+
+  ring.sq_head = (unsigned *) ((char *) ring.sq_ring + params.sq_off.head);
+  ring.sq_tail = (unsigned *) ((char *) ring.sq_ring + params.sq_off.tail);
+  ring.sq_mask = (unsigned *) ((char *) ring.sq_ring + params.sq_off.ring_mask);
+  ring.sq_array = (unsigned *) ((char *) ring.sq_ring + params.sq_off.array);
+  ring.cq_head = (unsigned *) ((char *) ring.cq_ring + params.cq_off.head);
+  ring.cq_tail = (unsigned *) ((char *) ring.cq_ring + params.cq_off.tail);
+  ring.cq_mask = (unsigned *) ((char *) ring.cq_ring + params.cq_off.ring_mask);
+  ring.cqes = (struct io_uring_cqe *) ((char *) ring.cq_ring + params.cq_off.cqes);
+
+  if (!probe_ops (&new_ops) || !new_ops)
+    {
+      elog_debug ("%s: required operations are not supported\n", __func__);
+      goto _err;
+    }
+
+  /* A sparse file table, so that the read can be linked to the open */
+  if (sys_io_uring_register (ring.fd, IORING_REGISTER_FILES, files, 1) < 0)
+    {
+      elog_debug ("%s: failed to register files: %s\n", __func__,
+                  strerror (errno));
+      goto _err;
+    }
+
+  if (!probe_direct_open ())
+    {
+      elog_debug ("%s: direct descriptors are not supported\n", __func__);
+      goto _err;
+    }
+
+  elog_debug ("%s: io_uring backend enabled\n", __func__);
+  return true;
+
+_err:
+  uring_destroy ();
+  return false;
+}
+
+void
+uring_destroy (void)
+{
+  if (ring.sqes != NULL)
+    munmap (ring.sqes, ring.sqes_size);
+  if (ring.sq_ring != NULL)
+    munmap (ring.sq_ring, ring.sq_ring_size);
+  if (ring.fd != -1)
+    close (ring.fd);
+
+  memset (&ring, 0, sizeof (ring));
+  ring.fd = -1;
+}
+
+bool
+uring_available (void)
+{
+  return ring.fd != -1;
+}
+
+/* Returns the next submission queue entry. The caller ensures there's
+   room: every operation submits and waits for all its entries. */
+static struct io_uring_sqe *
+get_sqe (unsigned *tail)
+{
+  const unsigned index = *tail & *ring.sq_mask;
+  struct io_uring_sqe *sqe = &ring.sqes[index];
+
+  memset (sqe, 0, sizeof (*sqe));
+  ring.sq_array[index] = index;
+  (*tail)++;
+
+  return sqe;
+}
+
+/* Submits the entries queued since `*ring.sq_tail` up to `tail` and waits
+   for all of them to complete. The results are stored in `res` indexed by
+   user_data. Returns false if the submission failed. */
+static bool
+submit_and_wait (unsigned tail, int *res, unsigned num)
+{
+  const unsigned to_submit = tail - *ring.sq_tail;
+  unsigned head;
+  unsigned done = 0;
+  int rc;
+
+  __atomic_store_n (ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+  do
+    rc = sys_io_uring_enter (ring.fd, to_submit, num, IORING_ENTER_GETEVENTS);
+  while (rc < 0 && errno == EINTR);
+
+  if (rc < 0)
+    {
+      elog_error ("io_uring_enter failed: %s\n", strerror (errno));
+      return false;
+    }
+
+  head = *ring.cq_head;
+  while (done < num)
+    {
+      unsigned cq_tail = __atomic_load_n (ring.cq_tail, __ATOMIC_ACQUIRE);
+
+      if (head == cq_tail)
+        {
+          /* Interrupted before all the entries completed */
+          __atomic_store_n (ring.cq_head, head, __ATOMIC_RELEASE);
+          do
+            rc = sys_io_uring_enter (ring.fd, 0, num - done,
+                                     IORING_ENTER_GETEVENTS);
+          while (rc < 0 && errno == EINTR);
+          if (rc < 0)
+            return false;
+          continue;
+        }
+
+      for (; head != cq_tail; head++, done++)
+        {
+          const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+          if (cqe->user_data < num)
+            res[cqe->user_data] = cqe->res;
+        }
+    }
+  __atomic_store_n (ring.cq_head, head, __ATOMIC_RELEASE);
+
+  return true;
+}
+
+/* Copies the fields of a file stamp from `stx` */
+static void
+stat_from_statx (const struct statx *stx, struct stat *st)
+{
+  memset (st, 0, sizeof (*st));
+  st->st_dev = makedev (stx->stx_dev_major, stx->stx_dev_minor);
+  st->st_ino = stx->stx_ino;
+  st->st_size = stx->stx_size;
+  st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+  st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+}
+
+static void
+prep_statx (struct io_uring_sqe *sqe, const char *path, struct statx *stx,
+            unsigned mask, uint64_t user_data)
+{
+  sqe->opcode = IORING_OP_STATX;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uintptr_t) path;
+  sqe->len = mask;
+  sqe->off = (uintptr_t) stx;
+  sqe->user_data = user_data;
+}
+
+char *
+uring_read_file (const char *path, size_t *len, struct stat *before,
+                 struct stat *after)
+{
+  enum { OP_STATX, OP_OPEN, OP_READ, OP_CLOSE, OP_STATX_AFTER, NUM_OPS };
+  static size_t size_hint = 0;
+  const bool stamped = before != NULL && after != NULL;
+  const unsigned num_ops = stamped ? NUM_OPS : OP_STATX_AFTER;
+  const unsigned mask = stamped ? STATX_INO | STATX_SIZE | STATX_MTIME
+                                : STATX_SIZE;
+  struct statx stx;
+  struct statx stx_after;
+  char *buf = NULL;
+  size_t cap = size_hint + URING_READ_SLACK;
+  int attempt;
+
+  for (attempt = 0; attempt < URING_MAX_READ_ATTEMPTS; attempt++)
+    {
+      int res[NUM_OPS] = { 0 };
+      unsigned tail = *ring.sq_tail;
+      struct io_uring_sqe *sqe;
+      char *p = realloc (buf, cap + 1);
+
+      if (unlikely (p == NULL))
+        {
+          free (buf);
+          errno = ENOMEM;
+          return NULL;
+        }
+      buf = p;
+
+      /* If only the size is needed (to tell whether the buffer was large
+         enough), statx runs alongside the read. The stamps of a snapshot
+         are taken before the open and after the close. */
+      sqe = get_sqe (&tail);
+      prep_statx (sqe, path, &stx, mask, OP_STATX);
+      if (stamped)
+        sqe->flags = IOSQE_IO_LINK;
+
+      sqe = get_sqe (&tail);
+      sqe->opcode = IORING_OP_OPENAT;
+      sqe->fd = AT_FDCWD;
+      sqe->addr = (uintptr_t) path;
+      /* O_CLOEXEC is not allowed (nor needed) for direct descriptors */
+      sqe->open_flags = O_RDONLY;
+      sqe->file_index = URING_FILE_SLOT + 1;
+      sqe->flags = IOSQE_IO_LINK;
+      sqe->user_data = OP_OPEN;
+
+      sqe = get_sqe (&tail);
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = URING_FILE_SLOT;
+      sqe->addr = (uintptr_t) buf;
+      sqe->len = cap > UINT32_MAX ? UINT32_MAX : (uint32_t) cap;
+      sqe->off = 0;
+      /* Close the file even if the read fails */
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+      sqe->user_data = OP_READ;
+
+      sqe = get_sqe (&tail);
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->file_index = URING_FILE_SLOT + 1;
+      sqe->user_data = OP_CLOSE;
+
+      if (stamped)
+        {
+          sqe->flags = IOSQE_IO_LINK;
+          sqe = get_sqe (&tail);
+          prep_statx (sqe, path, &stx_after, mask, OP_STATX_AFTER);
+        }
+
+      if (!submit_and_wait (tail, res, num_ops))
+        break;
+
+      if (res[OP_OPEN] < 0 || res[OP_READ] < 0)
+        {
+          errno = -(res[OP_OPEN] < 0 ? res[OP_OPEN] : res[OP_READ]);
+          break;
+        }
+      if (stamped && (res[OP_STATX] < 0 || res[OP_STATX_AFTER] < 0))
+        {
+          errno = -(res[OP_STATX] < 0 ? res[OP_STATX] : res[OP_STATX_AFTER]);
+          break;
+        }
+
+      /* A full buffer means there may be more to read */
+      if ((size_t) res[OP_READ] < cap
+          || (res[OP_STATX] == 0 && stx.stx_size <= (size_t) res[OP_READ]))
+        {
+          *len = (size_t) res[OP_READ];
+          buf[*len] = '\0';
+          size_hint = *len;
+          if (stamped)
+            {
+              stat_from_statx (&stx, before);
+              stat_from_statx (&stx_after, after);
+            }
+          return buf;
+        }
+
+      if (res[OP_STATX] == 0 && stx.stx_size + URING_READ_SLACK > cap)
+        cap = stx.stx_size + URING_READ_SLACK;
+      else
+        cap *= 2;
+    }
+
+  free (buf);
+  return NULL;
+}
+
+bool
+uring_write_frame (int fd, const char *body, uint32_t len, size_t *written)
+{
+  struct iovec iov[2];
+  int res[1] = { 0 };
+  unsigned tail = *ring.sq_tail;
+  struct io_uring_sqe *sqe;
+  size_t total = sizeof (len) + len;
+
+  *written = 0;
+  iov[0].iov_base = &len;
+  iov[0].iov_len = sizeof (len);
+  iov[1].iov_base = (void *) body;
+  iov[1].iov_len = len;
+
+  sqe = get_sqe (&tail);
+  sqe->opcode = IORING_OP_WRITEV;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t) iov;
+  sqe->len = 2;
+  sqe->off = (uint64_t) -1; /* Current position; works for pipes */
+  sqe->user_data = 0;
+
+  if (!submit_and_wait (tail, res, 1))
+    return false;
+  if (res[0] < 0)
+    {
+      errno = -res[0];
+      return false;
+    }
+
+  /* Finish a short write (e.g. a full pipe) with plain syscalls */
+  *written = (size_t) res[0];
+  while (*written < total)
+    {
+      ssize_t n;
+
+      if (*written < sizeof (len))
+        n = write (fd, (char *) &len + *written, sizeof (len) - *written);
+      else
+        n = write (fd, body + (*written - sizeof (len)), total - *written);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      *written += (size_t) n;
+    }
+
+  return true;
+}
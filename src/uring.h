@@ -0,0 +1,66 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * io_uring backend header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_URING_H__
+#define __BEECTL_URING_H__
+
+#include <stdbool.h>
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uint32_t */
+#include <sys/stat.h> /* struct stat */
+
+/* Sets up the ring if BEECTL_IO_URING=1 is set in the environment.
+   Returns false if io_uring is not enabled or unavailable (old kernel,
+   disabled by seccomp or sysctl), in which case the callers should use plain
+   syscalls. */
+bool uring_init (void);
+
+/* Tears down the ring */
+void uring_destroy (void);
+
+/* Returns true if the ring has been set up */
+bool uring_available (void);
+
+/* Reads an entire file with a single submission (statx, open, read and
+   close).
+
+   If `before` and `after` are not NULL, the same submission also stats the
+   file before the open and after the close, and the device, inode, size and
+   modification time are saved into them (the other fields are zeroed).
+
+   Returns the text read from the file as a null-terminated string. The string
+   length is saved into `len`. The returned string must be freed by the
+   caller. On error, NULL is returned, and errno is set. */
+char *uring_read_file (const char *path, size_t *len, struct stat *before,
+                       struct stat *after);
+
+/* Writes a native messaging frame (the 32-bit length followed by the body)
+   to `fd` with a single vectored write. The number of bytes written, also on
+   error, is saved into `written`.
+   Returns true on success. */
+bool uring_write_frame (int fd, const char *body, uint32_t len,
+                        size_t *written);
+
+#endif /* __BEECTL_URING_H__ */
@@ -0,0 +1,306 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * UTF-8 validation.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "utf8.h"
+#include "common.h"
+#include "simd.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h> /* malloc */
+#include <string.h> /* memcpy */
+#ifdef WINDOWS
+# define strcasecmp _stricmp
+#else
+# include <strings.h> /* strcasecmp */
+#endif
+
+#include <uv.h>
+
+/* Returns the offset of the first non-ASCII byte in `p`, or `len` */
+typedef size_t (*ascii_scan_fn) (const unsigned char *p, size_t len);
+
+static ascii_scan_fn scan_ascii;
+static uv_once_t scan_init_once = UV_ONCE_INIT;
+
+static size_t
+scan_ascii_scalar (const unsigned char *p, size_t len)
+{
+  size_t i = 0;
+
+  /* 8 bytes at a time */
+  for (; i + 8 <= len; i += 8)
+    {
+      uint64_t v;
+      memcpy (&v, p + i, sizeof (v));
+      if (v & 0x8080808080808080ULL)
+        break;
+    }
+  for (; i < len; i++)
+    if (p[i] & 0x80)
+      break;
+
+  return i;
+}
+
+#if defined(SIMD_X86)
+SIMD_TARGET ("sse2") static size_t
+scan_ascii_sse2 (const unsigned char *p, size_t len)
+{
+  size_t i = 0;
+
+  for (; i + 16 <= len; i += 16)
+    {
+      unsigned mask = (unsigned) _mm_movemask_epi8 (
+        _mm_loadu_si128 ((const __m128i *) (p + i)));
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_ascii_scalar (p + i, len - i);
+}
+
+# ifdef SIMD_HAVE_AVX2
+SIMD_TARGET ("avx2") static size_t
+scan_ascii_avx2 (const unsigned char *p, size_t len)
+{
+  size_t i = 0;
+
+  for (; i + 64 <= len; i += 64)
+    {
+      __m256i a = _mm256_loadu_si256 ((const __m256i *) (p + i));
+      __m256i b = _mm256_loadu_si256 ((const __m256i *) (p + i + 32));
+      if (_mm256_movemask_epi8 (_mm256_or_si256 (a, b)))
+        break;
+    }
+  for (; i + 32 <= len; i += 32)
+    {
+      unsigned mask = (unsigned) _mm256_movemask_epi8 (
+        _mm256_loadu_si256 ((const __m256i *) (p + i)));
+      if (mask)
+        return i + count_trailing_zeros (mask);
+    }
+
+  return i + scan_ascii_sse2 (p + i, len - i);
+}
+# endif /* SIMD_HAVE_AVX2 */
+#endif /* SIMD_X86 */
+
+static void
+init_scan_kernels (void)
+{
+  switch (simd_get_level ())
+    {
+#if defined(SIMD_X86)
+# ifdef SIMD_HAVE_AVX2
+    case SIMD_AVX2:
+      scan_ascii = scan_ascii_avx2;
+      break;
+# endif
+    case SIMD_SSE2:
+      scan_ascii = scan_ascii_sse2;
+      break;
+#endif
+    default:
+      scan_ascii = scan_ascii_scalar;
+    }
+}
+
+/* Checks the multibyte sequence starting at `p` (a non-ASCII byte).
+   Returns the length of the sequence, 0 if it is invalid, or -1 if it is
+   valid so far, but cut short by the end of input. */
+static int
+sequence_len (const unsigned char *p, size_t avail)
+{
+  const unsigned char c = *p;
+  unsigned char lo = 0x80;
+  unsigned char hi = 0xbf;
+  int len;
+  int i;
+
+  if (c < 0xc2)
+    return 0;
+  if (c < 0xe0)
+    len = 2;
+  else if (c < 0xf0)
+    {
+      len = 3;
+      if (c == 0xe0)
+        lo = 0xa0; /* Overlong */
+      else if (c == 0xed)
+        hi = 0x9f; /* Surrogates */
+    }
+  else if (c < 0xf5)
+    {
+      len = 4;
+      if (c == 0xf0)
+        lo = 0x90; /* Overlong */
+      else if (c == 0xf4)
+        hi = 0x8f; /* Above U+10FFFF */
+    }
+  else
+    return 0;
+
+  for (i = 1; i < len; i++)
+    {
+      if ((size_t) i >= avail)
+        return -1;
+      if (p[i] < lo || p[i] > hi)
+        return 0;
+      lo = 0x80;
+      hi = 0xbf;
+    }
+
+  return len;
+}
+
+utf8_status_t
+utf8_validate (const char *s, size_t len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char * const end = p + len;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  for (;;)
+    {
+      p += scan_ascii (p, end - p);
+      if (p == end)
+        return UTF8_VALID;
+
+      /* Non-ASCII text usually continues with non-ASCII characters */
+      do
+        {
+          int n = sequence_len (p, end - p);
+
+          if (n == 0)
+            return UTF8_INVALID;
+          if (n < 0)
+            return UTF8_TRUNCATED;
+          p += n;
+        }
+      while (p < end && (*p & 0x80));
+    }
+}
+
+/* Windows-1252 characters 0x80-0x9f. Undefined ones map to U+FFFD. */
+static const uint16_t windows_1252[32] = {
+  0x20ac, 0xfffd, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+  0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0xfffd, 0x017d, 0xfffd,
+  0xfffd, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+  0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0xfffd, 0x017e, 0x0178,
+};
+
+static forceinline char *
+encode_bmp (char *out, unsigned cp)
+{
+  if (cp < 0x80)
+    *out++ = (char) cp;
+  else if (cp < 0x800)
+    {
+      *out++ = (char) (0xc0 | (cp >> 6));
+      *out++ = (char) (0x80 | (cp & 0x3f));
+    }
+  else
+    {
+      *out++ = (char) (0xe0 | (cp >> 12));
+      *out++ = (char) (0x80 | ((cp >> 6) & 0x3f));
+      *out++ = (char) (0x80 | (cp & 0x3f));
+    }
+  return out;
+}
+
+char *
+utf8_repair (const char *s, size_t len, utf8_fallback_t fallback,
+             size_t *out_len)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  const unsigned char * const end = p + len;
+  char *out;
+  char *o;
+
+  uv_once (&scan_init_once, init_scan_kernels);
+
+  /* Every input byte yields at most 3 bytes (U+FFFD or a Windows-1252
+     character) */
+  if (unlikely (len > (SIZE_MAX - 1) / 3))
+    return NULL;
+  out = malloc (len * 3 + 1);
+  if (unlikely (out == NULL))
+    return NULL;
+  o = out;
+
+  while (p < end)
+    {
+      size_t run = scan_ascii (p, end - p);
+      int n;
+
+      memcpy (o, p, run);
+      o += run;
+      p += run;
+      if (p == end)
+        break;
+
+      switch (fallback)
+        {
+        case UTF8_FALLBACK_LATIN1:
+          o = encode_bmp (o, *p++);
+          break;
+        case UTF8_FALLBACK_WINDOWS_1252:
+          o = encode_bmp (o, *p < 0xa0 ? windows_1252[*p - 0x80] : *p);
+          p++;
+          break;
+        default:
+          n = sequence_len (p, end - p);
+          if (n > 0)
+            {
+              memcpy (o, p, n);
+              o += n;
+              p += n;
+            }
+          else
+            {
+              o = encode_bmp (o, 0xfffd);
+              p++;
+            }
+        }
+    }
+
+  *o = '\0';
+  *out_len = o - out;
+  return out;
+}
+
+utf8_fallback_t
+utf8_fallback_from_name (const char *name)
+{
+  if (name == NULL)
+    return UTF8_FALLBACK_REPLACE;
+  if (!strcasecmp (name, "latin1") || !strcasecmp (name, "iso-8859-1"))
+    return UTF8_FALLBACK_LATIN1;
+  if (!strcasecmp (name, "windows-1252") || !strcasecmp (name, "cp1252"))
+    return UTF8_FALLBACK_WINDOWS_1252;
+  return UTF8_FALLBACK_REPLACE;
+}
@@ -0,0 +1,70 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * UTF-8 validation header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_UTF8_H__
+#define __BEECTL_UTF8_H__
+
+#include <stddef.h> /* size_t */
+
+/* Byte order mark */
+#define UTF8_BOM "\xef\xbb\xbf"
+#define UTF8_BOM_LEN (sizeof (UTF8_BOM) - 1)
+
+typedef enum _utf8_status_t {
+  UTF8_VALID = 0,
+  /* The text ends with an incomplete sequence, which is what a file being
+     written looks like */
+  UTF8_TRUNCATED,
+  UTF8_INVALID,
+} utf8_status_t;
+
+/* Encodings used to decode text which is not valid UTF-8 */
+typedef enum _utf8_fallback_t {
+  /* Replace invalid sequences with U+FFFD */
+  UTF8_FALLBACK_REPLACE = 0,
+  UTF8_FALLBACK_LATIN1,
+  UTF8_FALLBACK_WINDOWS_1252,
+} utf8_fallback_t;
+
+/* Validates `len` bytes of `s` */
+utf8_status_t utf8_validate (const char *s, size_t len);
+
+/* Converts text which is not valid UTF-8 into UTF-8.
+
+   With UTF8_FALLBACK_REPLACE, valid sequences are kept as is, and every
+   invalid byte is replaced with U+FFFD. Otherwise, the whole text is decoded
+   from the fallback encoding.
+
+   Returns a null-terminated string; its length is saved into `out_len`.
+   On error, NULL is returned. The returned string must be freed by the
+   caller. */
+char *utf8_repair (const char *s, size_t len, utf8_fallback_t fallback,
+                   size_t *out_len);
+
+/* Returns the fallback encoding for an encoding name such as "latin1" or
+   "windows-1252". Unknown names yield UTF8_FALLBACK_REPLACE. */
+utf8_fallback_t utf8_fallback_from_name (const char *name);
+
+#endif /* __BEECTL_UTF8_H__ */
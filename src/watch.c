@@ -0,0 +1,142 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * File change debouncing.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "watch.h"
+#include "common.h"
+#include "probes.h"
+
+static response_status_t
+do_flush (watch_t *watch, bool final)
+{
+  response_status_t status = watch->flush (final, watch->arg);
+
+  watch->num_flushes++;
+  if (status == RESPONSE_SENT)
+    {
+      watch->num_sent++;
+      if (watch->sent != NULL)
+        watch->sent (watch->pending
+                     ? watch->env.now (watch->env.ctx) - watch->change_time
+                     : 0,
+                     watch->arg);
+    }
+  if (status != RESPONSE_INCOMPLETE)
+    watch->pending = false;
+
+  return status;
+}
+
+/* Counts an event, and remembers the time of the first unanswered one */
+static void
+set_pending (watch_t *watch)
+{
+  watch->num_events++;
+  if (!watch->pending)
+    {
+      watch->change_time = watch->env.now (watch->env.ctx);
+      watch->pending = true;
+    }
+}
+
+static void
+start_timer (watch_t *watch)
+{
+  watch->env.timer_start (watch->env.ctx, watch->delay_ms);
+  watch->timer_started = true;
+}
+
+static void
+stop_timer (watch_t *watch)
+{
+  if (!watch->timer_started)
+    return;
+  watch->env.timer_stop (watch->env.ctx);
+  watch->timer_started = false;
+}
+
+void
+watch_init (watch_t *watch, const watch_env_t *env, uint64_t delay_ms,
+            watch_flush_cb_t flush, watch_sent_cb_t sent, void *arg)
+{
+  *watch = (watch_t) {
+    .env = *env,
+    .flush = flush,
+    .sent = sent,
+    .arg = arg,
+    .delay_ms = delay_ms,
+  };
+}
+
+void
+watch_event (watch_t *watch)
+{
+  set_pending (watch);
+
+  /* The changes of all files saved at once are sent together */
+  stop_timer (watch);
+  start_timer (watch);
+}
+
+void
+watch_poll (watch_t *watch, bool changed)
+{
+  if (!changed)
+    return;
+
+  set_pending (watch);
+  /* An incomplete file stays changed, and is read again on the next tick */
+  do_flush (watch, false);
+}
+
+void
+watch_timer_expired (watch_t *watch)
+{
+  elog_debug ("%s: debounced file change confirmed\n", __func__);
+  watch->timer_started = false;
+  BEECTL_PROBE0 (debounce_fire);
+
+  if (do_flush (watch, false) == RESPONSE_INCOMPLETE)
+    {
+      /* The editor is probably still writing a file */
+      start_timer (watch);
+    }
+}
+
+void
+watch_flush (watch_t *watch)
+{
+  if (!watch->timer_started)
+    return;
+
+  stop_timer (watch);
+  watch_timer_expired (watch);
+}
+
+response_status_t
+watch_finish (watch_t *watch)
+{
+  stop_timer (watch);
+  return do_flush (watch, true);
+}
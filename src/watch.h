@@ -0,0 +1,104 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * File change debouncing header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_WATCH_H__
+#define __BEECTL_WATCH_H__
+
+#include "io.h" /* response_status_t */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The engine deciding when the changes of the edited files are sent to the
+   browser. It doesn't deal with files or timers itself:
+
+   - the event source reports changes with watch_event() (a raw change event
+     of a watched file) or watch_poll() (a polling tick);
+   - the clock and the one-shot debounce timer are provided by a
+     watch_env_t; the timer calls watch_timer_expired();
+   - the changes are sent by the flush callback.
+
+   A sequence of events is thus debounced into one flush `delay_ms` after
+   the last event. If the flush finds a file incomplete
+   (RESPONSE_INCOMPLETE), it is retried after another delay.
+
+   watch_uv_init() (see watch_uv.h) runs the engine on a libuv loop. Tests
+   and benchmarks provide a watch_env_t with virtual time instead, and inject
+   synthetic events (see tests/watch-test.c). */
+
+typedef struct _watch_env_t {
+  /* Returns the current time in nanoseconds */
+  uint64_t (*now) (void *ctx);
+  /* Starts the one-shot timer, or restarts it if it is running */
+  void (*timer_start) (void *ctx, uint64_t delay_ms);
+  void (*timer_stop) (void *ctx);
+  void *ctx;
+} watch_env_t;
+
+/* Sends the changes to the browser; all texts as they are if `final` */
+typedef response_status_t (*watch_flush_cb_t) (bool final, void *arg);
+
+/* Called when a flush has sent a response. `latency_ns` is the time since
+   the first event the response answers, or 0 if there was none. */
+typedef void (*watch_sent_cb_t) (uint64_t latency_ns, void *arg);
+
+typedef struct _watch_t {
+  watch_env_t env;
+  watch_flush_cb_t flush;
+  watch_sent_cb_t sent; /* May be NULL */
+  void *arg;
+  uint64_t delay_ms;
+  bool timer_started;
+  /* Whether there is an event not answered with a response yet */
+  bool pending;
+  /* Time of the first such event */
+  uint64_t change_time;
+  /* Counters for tests and benchmarks */
+  uint64_t num_events;
+  uint64_t num_flushes;
+  uint64_t num_sent;
+} watch_t;
+
+void watch_init (watch_t *watch, const watch_env_t *env, uint64_t delay_ms,
+                 watch_flush_cb_t flush, watch_sent_cb_t sent, void *arg);
+
+/* Reports a raw change event; (re)starts the debounce delay */
+void watch_event (watch_t *watch);
+
+/* Reports a polling tick. If `changed`, the changes are flushed at once:
+   the polling interval debounces them already. */
+void watch_poll (watch_t *watch, bool changed);
+
+/* To be called by the timer of the environment */
+void watch_timer_expired (watch_t *watch);
+
+/* Flushes a change waiting for the debounce delay right away, e.g. before
+   the file is overwritten with an update from the browser */
+void watch_flush (watch_t *watch);
+
+/* Stops the timer, and sends the final texts */
+response_status_t watch_finish (watch_t *watch);
+
+#endif /* __BEECTL_WATCH_H__ */
@@ -0,0 +1,71 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * The watch engine on a libuv loop.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "watch_uv.h"
+
+static uint64_t
+uv_env_now (void *ctx)
+{
+  return uv_hrtime ();
+}
+
+static void
+on_uv_timer (uv_timer_t *timer)
+{
+  watch_uv_t *watch_uv = timer->data;
+
+  watch_timer_expired (&watch_uv->watch);
+}
+
+static void
+uv_env_timer_start (void *ctx, uint64_t delay_ms)
+{
+  uv_timer_start (ctx, on_uv_timer, delay_ms, 0);
+}
+
+static void
+uv_env_timer_stop (void *ctx)
+{
+  uv_timer_stop (ctx);
+}
+
+int
+watch_uv_init (watch_uv_t *watch_uv, uv_loop_t *loop, uint64_t delay_ms,
+               watch_flush_cb_t flush, watch_sent_cb_t sent, void *arg)
+{
+  watch_env_t env = {
+    .now = uv_env_now,
+    .timer_start = uv_env_timer_start,
+    .timer_stop = uv_env_timer_stop,
+    .ctx = &watch_uv->timer,
+  };
+  int res = uv_timer_init (loop, &watch_uv->timer);
+
+  if (res < 0)
+    return res;
+  watch_uv->timer.data = watch_uv;
+  watch_init (&watch_uv->watch, &env, delay_ms, flush, sent, arg);
+  return 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * The watch engine on a libuv loop header.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef __BEECTL_WATCH_UV_H__
+#define __BEECTL_WATCH_UV_H__
+
+#include "watch.h"
+
+#include <stdint.h>
+
+#include <uv.h>
+
+/* The engine of watch.h with the clock and a timer of a libuv loop */
+typedef struct _watch_uv_t {
+  watch_t watch;
+  uv_timer_t timer;
+} watch_uv_t;
+
+/* Initializes the engine with the clock and a timer of `loop`.
+   Returns 0, or a libuv error code. */
+int watch_uv_init (watch_uv_t *watch_uv, uv_loop_t *loop, uint64_t delay_ms,
+                   watch_flush_cb_t flush, watch_sent_cb_t sent, void *arg);
+
+#endif /* __BEECTL_WATCH_UV_H__ */
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# Startup time of beectl: from exec until read_browser_request() returns.
+#
+# Every launch gets a request nested deeper than the admission limit (see
+# src/admission.h). beectl rejects it right after reading it, so the time
+# until its error response arrives is the startup plus a constant of a few
+# microseconds. The request is in the pipe before the launch, so reading it
+# never waits for this script.
+#
+# With --baseline, the launches of the two builds alternate, so that both see
+# the same state of the machine:
+#
+#   startup-bench.py --beectl build-pgo/beectl --baseline build-release/beectl
+#
+# Usage:
+#   startup-bench.py --beectl PATH [--baseline PATH] [--launches N]
+#                    [--warmup N]
+
+import argparse
+import json
+import os
+import statistics
+import struct
+import sys
+import time
+
+# Deeper than the default BEECTL_MAX_DEPTH
+DEPTH = 64
+
+
+def make_request():
+    body = b'{"x":' + b"[" * DEPTH + b"]" * DEPTH + b"}"
+    return struct.pack("=I", len(body)) + body
+
+
+def read_exactly(fd, n):
+    data = b""
+    while len(data) < n:
+        chunk = os.read(fd, n - len(data))
+        if not chunk:
+            break
+        data += chunk
+    return data
+
+
+def launch(beectl, request, env, devnull):
+    """Returns the nanoseconds from the launch until the response"""
+    stdin_r, stdin_w = os.pipe()
+    stdout_r, stdout_w = os.pipe()
+    os.write(stdin_w, request)
+    os.close(stdin_w)
+    actions = [
+        (os.POSIX_SPAWN_DUP2, stdin_r, 0),
+        (os.POSIX_SPAWN_DUP2, stdout_w, 1),
+        (os.POSIX_SPAWN_DUP2, devnull, 2),
+    ]
+
+    start = time.perf_counter_ns()
+    pid = os.posix_spawn(beectl, [beectl], env, file_actions=actions)
+    os.close(stdin_r)
+    os.close(stdout_w)
+    header = read_exactly(stdout_r, 4)
+    elapsed = time.perf_counter_ns() - start
+
+    body = b""
+    if len(header) == 4:
+        body = read_exactly(stdout_r, struct.unpack("=I", header)[0])
+    os.close(stdout_r)
+    os.waitpid(pid, 0)
+
+    try:
+        code = json.loads(body.decode("utf-8"))["error"]["code"]
+    except (ValueError, KeyError, TypeError):
+        code = None
+    if code != "too_deep":
+        sys.exit("startup: %s did not reject the request (%r)" % (beectl, body))
+    return elapsed
+
+
+def report(name, samples):
+    ms = sorted(s / 1e6 for s in samples)
+    print("startup: %-28s min %7.3f  median %7.3f  p90 %7.3f  p99 %7.3f ms"
+          % (name, ms[0], statistics.median(ms), ms[int(len(ms) * 0.9)],
+             ms[int(len(ms) * 0.99)]))
+    return statistics.median(ms)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl startup benchmark")
+    parser.add_argument("--beectl", required=True)
+    parser.add_argument("--baseline", help="build to compare with")
+    parser.add_argument("--launches", type=int, default=1000)
+    parser.add_argument("--warmup", type=int, default=20,
+                        help="launches not measured")
+    args = parser.parse_args()
+
+    env = dict(os.environ)
+    for name in ("BEECTL_STATS", "BEECTL_MAX_DEPTH"):
+        env.pop(name, None)
+
+    builds = [args.beectl]
+    if args.baseline:
+        builds.append(args.baseline)
+    request = make_request()
+    samples = {b: [] for b in builds}
+
+    devnull = os.open(os.devnull, os.O_WRONLY)
+    for i in range(args.warmup + args.launches):
+        for beectl in builds:
+            elapsed = launch(beectl, request, env, devnull)
+            if i >= args.warmup:
+                samples[beectl].append(elapsed)
+    os.close(devnull)
+
+    medians = [report(b, samples[b]) for b in builds]
+    if len(medians) == 2:
+        print("startup: median difference %+.3f ms (%+.1f%%)"
+              % (medians[0] - medians[1],
+                 (medians[0] - medians[1]) / medians[1] * 100))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Summarizes the editor telemetry in a BEECTL_STATS file (see src/stats.c)
+# per editor executable: how long the editors take to start and run, and
+# the CPU time and memory they use. Helps to tell whether slowness comes
+# from beectl or from the editor, and which editor configurations are worth
+# moving to a server/client launch.
+#
+# Usage:
+#   stats-summary.py STATS_FILE...
+
+import json
+import statistics
+import sys
+
+COLUMNS = [
+    ("startup_ms", "startup ms"),
+    ("wall_ms", "wall ms"),
+    ("cpu_ms", "cpu ms"),
+    ("maxrss_kb", "maxrss kB"),
+]
+
+
+def summarize(values):
+    values = sorted(v for v in values if v >= 0)
+    if not values:
+        return "-"
+    p90 = values[min(len(values) - 1, int(len(values) * 0.9))]
+    return "%.0f/%.0f" % (statistics.median(values), p90)
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("usage: stats-summary.py STATS_FILE...")
+
+    editors = {}
+    for path in sys.argv[1:]:
+        with open(path) as f:
+            for line in f:
+                sample = json.loads(line)
+                if sample.get("event") != "editor":
+                    continue
+                if sample["user_ms"] >= 0:
+                    sample["cpu_ms"] = sample["user_ms"] + sample["sys_ms"]
+                else:
+                    sample["cpu_ms"] = -1
+                editors.setdefault(sample["editor"], []).append(sample)
+
+    print("%-20s %8s" % ("editor", "sessions")
+          + "".join(" %16s" % title for _, title in COLUMNS))
+    print("%-20s %8s" % ("", "")
+          + "".join(" %16s" % "median/p90" for _ in COLUMNS))
+    for name, samples in sorted(editors.items()):
+        print("%-20s %8d" % (name, len(samples))
+              + "".join(" %16s" % summarize([s[key] for s in samples])
+                        for key, _ in COLUMNS))
+
+
+if __name__ == "__main__":
+    main()
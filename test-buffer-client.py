@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Stand-in for an editor plugin pushing buffer updates to beectl.
+#
+# beectl listens on a per-session socket when the request contains
+# "buffer_socket": true, and passes its path to the editor in the
+# BEECTL_BUFFER_SOCKET environment variable. Run this script from the editor
+# (e.g. `:!test-buffer-client.py "new text"` in Vim), or from a wrapper used
+# as the editor.
+#
+# Usage:
+#   test-buffer-client.py [--socket PATH] [--id ID] [--type] [--interval S]
+#                         TEXT
+#
+# --type pushes every prefix of TEXT, one character at a time, like a user
+# typing with live preview.
+
+import argparse
+import json
+import os
+import socket
+import struct
+import sys
+import time
+
+
+def connect(path):
+    if sys.platform == "win32":
+        # Named pipe
+        return open(path, "r+b", buffering=0)
+    sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    sock.connect(path)
+    return sock.makefile("wb", buffering=0)
+
+
+def push(stream, text, field_id):
+    message = {"text": text}
+    if field_id is not None:
+        message["id"] = field_id
+    body = json.dumps(message).encode("utf-8")
+    stream.write(struct.pack("=I", len(body)) + body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="beectl buffer channel client")
+    parser.add_argument("--socket", default=os.environ.get("BEECTL_BUFFER_SOCKET"))
+    parser.add_argument("--id", help="field ID in a multi-field session")
+    parser.add_argument("--type", action="store_true",
+                        help="push the text one character at a time")
+    parser.add_argument("--interval", type=float, default=0.05)
+    parser.add_argument("text")
+    args = parser.parse_args()
+
+    if not args.socket:
+        parser.error("--socket or BEECTL_BUFFER_SOCKET is required")
+
+    stream = connect(args.socket)
+    if args.type:
+        for i in range(1, len(args.text) + 1):
+            push(stream, args.text[:i], args.id)
+            time.sleep(args.interval)
+    else:
+        push(stream, args.text, args.id)
+    stream.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,61 @@
+# Checks the USDT probes of a beectl built with -DBEECTL_USDT=ON (ctest).
+#
+# Every probe fired in src/ and every probe the scripts in bpftrace/ attach to
+# must have a stapsdt note of the "beectl" provider in the binary, as listed
+# by `readelf -n`. Otherwise, bpftrace refuses to attach, or a stage is
+# silently missing from the histograms.
+#
+# Usage:
+#   cmake -DBEECTL=PATH -DREADELF=PATH -DSOURCE_DIR=PATH -P usdt-notes.cmake
+
+foreach(var BEECTL READELF SOURCE_DIR)
+  if(NOT DEFINED ${var})
+    message(FATAL_ERROR "${var} is not set")
+  endif()
+endforeach()
+
+execute_process(COMMAND ${READELF} -n ${BEECTL}
+                OUTPUT_VARIABLE notes
+                RESULT_VARIABLE res)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "${READELF} -n ${BEECTL} failed")
+endif()
+
+set(probes)
+file(GLOB sources ${SOURCE_DIR}/src/*.c)
+foreach(source ${sources})
+  file(STRINGS ${source} lines REGEX "BEECTL_PROBE[0-2] \\(")
+  string(REGEX MATCHALL "BEECTL_PROBE[0-2] \\([a-z_]+" calls "${lines}")
+  foreach(call ${calls})
+    string(REGEX REPLACE ".*\\(" "" probe "${call}")
+    list(APPEND probes ${probe})
+  endforeach()
+endforeach()
+
+file(GLOB scripts ${SOURCE_DIR}/bpftrace/*.bt)
+foreach(script ${scripts})
+  file(STRINGS ${script} lines REGEX "usdt:")
+  string(REGEX MATCHALL "usdt:[^:]*:beectl:[a-z_]+" uses "${lines}")
+  foreach(use ${uses})
+    string(REGEX REPLACE ".*:" "" probe "${use}")
+    list(APPEND probes ${probe})
+  endforeach()
+endforeach()
+
+list(REMOVE_DUPLICATES probes)
+list(LENGTH probes num_probes)
+if(num_probes EQUAL 0)
+  message(FATAL_ERROR "No probes found in ${SOURCE_DIR}")
+endif()
+
+set(missing)
+foreach(probe ${probes})
+  if(NOT notes MATCHES "Provider: beectl\n[ \t]*Name: ${probe}\n")
+    list(APPEND missing ${probe})
+  endif()
+endforeach()
+
+if(missing)
+  message(FATAL_ERROR "No stapsdt notes in ${BEECTL} for: ${missing}")
+endif()
+message(STATUS "${num_probes} probes have stapsdt notes")
@@ -0,0 +1,275 @@
+/**
+ * Native messaging host for Bee browser extension.
+ * Tests of the watch engine with a virtual clock.
+ *
+ * Copyright © 2019-2025 Ruslan Osmanov <608192+rosmanov@users.noreply.github.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include "watch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NS_PER_MS 1000000ULL
+
+/* Debounce delay of beectl */
+#define DELAY_MS 100
+
+#define CHECK(cond)                                                     \
+  do                                                                    \
+    {                                                                   \
+      if (!(cond))                                                      \
+        {                                                               \
+          fprintf (stderr, "%s:%d: %s: check failed: %s\n", __FILE__,   \
+                   __LINE__, __func__, #cond);                          \
+          exit (EXIT_FAILURE);                                          \
+        }                                                               \
+    }                                                                   \
+  while (0)
+
+/* Virtual clock and timer, and a record of the flushes */
+typedef struct _sim_t {
+  watch_t watch;
+  uint64_t now_ms;
+  bool timer_running;
+  uint64_t deadline_ms;
+  /* Statuses returned by the next flushes; RESPONSE_SENT after them */
+  const response_status_t *statuses;
+  unsigned num_statuses;
+  unsigned num_flushes;
+  uint64_t flush_ms[8];
+  bool last_final;
+  uint64_t latency_ms;
+} sim_t;
+
+static uint64_t
+sim_now (void *ctx)
+{
+  return ((sim_t *) ctx)->now_ms * NS_PER_MS;
+}
+
+static void
+sim_timer_start (void *ctx, uint64_t delay_ms)
+{
+  sim_t *sim = ctx;
+
+  sim->timer_running = true;
+  sim->deadline_ms = sim->now_ms + delay_ms;
+}
+
+static void
+sim_timer_stop (void *ctx)
+{
+  ((sim_t *) ctx)->timer_running = false;
+}
+
+static response_status_t
+sim_flush (bool final, void *arg)
+{
+  sim_t *sim = arg;
+
+  if (sim->num_flushes < sizeof (sim->flush_ms) / sizeof (sim->flush_ms[0]))
+    sim->flush_ms[sim->num_flushes] = sim->now_ms;
+  sim->num_flushes++;
+  sim->last_final = final;
+
+  if (sim->num_statuses > 0)
+    {
+      sim->num_statuses--;
+      return *sim->statuses++;
+    }
+  return RESPONSE_SENT;
+}
+
+static void
+sim_sent (uint64_t latency_ns, void *arg)
+{
+  ((sim_t *) arg)->latency_ms = latency_ns / NS_PER_MS;
+}
+
+/* The clock starts at 0 */
+static void
+sim_init (sim_t *sim)
+{
+  watch_env_t env = {
+    .now = sim_now,
+    .timer_start = sim_timer_start,
+    .timer_stop = sim_timer_stop,
+    .ctx = sim,
+  };
+
+  *sim = (sim_t) { 0 };
+  watch_init (&sim->watch, &env, DELAY_MS, sim_flush, sim_sent, sim);
+}
+
+/* Moves the clock to `ms`, firing the timer on the way */
+static void
+sim_advance (sim_t *sim, uint64_t ms)
+{
+  while (sim->timer_running && sim->deadline_ms <= ms)
+    {
+      sim->now_ms = sim->deadline_ms;
+      sim->timer_running = false;
+      watch_timer_expired (&sim->watch);
+    }
+  sim->now_ms = ms;
+}
+
+/* A burst of events is debounced into one flush after the last event; the
+   latency counts from the first one, even at time 0 */
+static void
+test_burst (void)
+{
+  sim_t sim;
+  uint64_t t;
+
+  sim_init (&sim);
+  for (t = 0; t <= 40; t += 10)
+    {
+      sim_advance (&sim, t);
+      watch_event (&sim.watch);
+    }
+  sim_advance (&sim, 1000);
+
+  CHECK (sim.watch.num_events == 5);
+  CHECK (sim.num_flushes == 1);
+  CHECK (sim.flush_ms[0] == 40 + DELAY_MS);
+  CHECK (!sim.last_final);
+  CHECK (sim.watch.num_sent == 1);
+  CHECK (sim.latency_ms == 40 + DELAY_MS);
+}
+
+/* An incomplete file is read again after every delay */
+static void
+test_incomplete_retries (void)
+{
+  static const response_status_t statuses[] = {
+    RESPONSE_INCOMPLETE, RESPONSE_INCOMPLETE,
+  };
+  sim_t sim;
+
+  sim_init (&sim);
+  sim.statuses = statuses;
+  sim.num_statuses = 2;
+  sim_advance (&sim, 20);
+  watch_event (&sim.watch);
+  sim_advance (&sim, 1000);
+
+  CHECK (sim.num_flushes == 3);
+  CHECK (sim.flush_ms[0] == 20 + DELAY_MS);
+  CHECK (sim.flush_ms[1] == 20 + 2 * DELAY_MS);
+  CHECK (sim.flush_ms[2] == 20 + 3 * DELAY_MS);
+  CHECK (sim.watch.num_sent == 1);
+  CHECK (sim.latency_ms == 3 * DELAY_MS);
+}
+
+/* A flush sends the pending change at once and cancels the timer */
+static void
+test_flush (void)
+{
+  sim_t sim;
+
+  sim_init (&sim);
+  watch_event (&sim.watch);
+  sim_advance (&sim, 30);
+  watch_flush (&sim.watch);
+  CHECK (sim.num_flushes == 1);
+  CHECK (sim.flush_ms[0] == 30);
+  CHECK (sim.latency_ms == 30);
+
+  sim_advance (&sim, 1000);
+  CHECK (sim.num_flushes == 1);
+
+  /* Nothing is pending */
+  watch_flush (&sim.watch);
+  CHECK (sim.num_flushes == 1);
+}
+
+/* A polling tick with a change sends at once; one without is ignored */
+static void
+test_poll (void)
+{
+  sim_t sim;
+
+  sim_init (&sim);
+  sim_advance (&sim, 50);
+  watch_poll (&sim.watch, false);
+  CHECK (sim.num_flushes == 0);
+  watch_poll (&sim.watch, true);
+  CHECK (sim.num_flushes == 1);
+  CHECK (sim.flush_ms[0] == 50);
+  CHECK (sim.watch.num_sent == 1);
+  CHECK (!sim.timer_running);
+}
+
+/* The final flush stops a pending timer */
+static void
+test_finish (void)
+{
+  sim_t sim;
+
+  sim_init (&sim);
+  watch_event (&sim.watch);
+  sim_advance (&sim, 10);
+  CHECK (watch_finish (&sim.watch) == RESPONSE_SENT);
+  CHECK (sim.num_flushes == 1);
+  CHECK (sim.last_final);
+  CHECK (!sim.timer_running);
+  CHECK (sim.latency_ms == 10);
+}
+
+/* Reports the cost of an event, which runs for every raw event of the
+   watched files */
+static void
+bench_event (void)
+{
+  enum { N = 10000000 };
+  struct timespec start, end;
+  sim_t sim;
+  double ns;
+  unsigned i;
+
+  sim_init (&sim);
+  clock_gettime (CLOCK_MONOTONIC, &start);
+  for (i = 0; i < N; i++)
+    watch_event (&sim.watch);
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  CHECK (sim.watch.num_events == N);
+
+  ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  printf ("watch_event: %.1f ns\n", ns / N);
+}
+
+int
+main (int argc, char *argv[])
+{
+  test_burst ();
+  test_incomplete_retries ();
+  test_flush ();
+  test_poll ();
+  test_finish ();
+  printf ("watch: all tests passed\n");
+
+  if (argc > 1)
+    bench_event ();
+  return EXIT_SUCCESS;
+}